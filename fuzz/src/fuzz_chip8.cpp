@@ -0,0 +1,87 @@
+// libFuzzer entry point: every input is loaded as a game on a fresh Chip8 and
+// run for a bounded number of instructions. Build with clang to fuzz, or with
+// any other compiler to replay inputs through standalone.cpp.
+//
+//   ./bin/fuzz_chip8 corpus/ ../games/
+//
+// CHIP8_FUZZ_QUIRKS=cosmac|schip|xochip selects the quirks profile (chip8 by default).
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "chip8.h"
+
+#define FUZZ_MAX_CYCLES 20000
+#define FUZZ_CYCLES_PER_FRAME 9 // ~500Hz at 60 frames per second
+
+// Extra coverage on top of the compiler's edge counters: which addresses the
+// game reached, and which opcode handlers it exercised. libFuzzer picks up
+// counters placed in this section on its own.
+#if defined(__linux__)
+#define FUZZ_COUNTERS __attribute__((section("__libfuzzer_extra_counters")))
+#else
+#define FUZZ_COUNTERS
+#endif
+
+FUZZ_COUNTERS static uint8_t pc_coverage[Chip8::RAM_SIZE];
+FUZZ_COUNTERS static uint8_t opcode_coverage[4096]; // high nibble + low byte
+
+// Constructed once with the font loaded, hashed and the profile set. Every
+// input starts from a copy of it, only as large as the profile's memory,
+// and loading the input then only hashes the input's own bytes.
+static Chip8* initial_state;
+static Chip8* chip8;
+static Chip8Quirks quirks = QUIRKS_CHIP8;
+
+
+extern "C" int LLVMFuzzerInitialize(int* argc, char*** argv) {
+    const char* profile = getenv("CHIP8_FUZZ_QUIRKS");
+    if (profile != NULL && strcmp(profile, "cosmac") == 0) {
+        quirks = QUIRKS_COSMAC;
+    } else if (profile != NULL && strcmp(profile, "schip") == 0) {
+        quirks = QUIRKS_SCHIP;
+    } else if (profile != NULL && strcmp(profile, "xochip") == 0) {
+        quirks = QUIRKS_XOCHIP;
+    }
+
+    initial_state = new Chip8();
+    static const unsigned char no_game[1] = { 0 };
+    initial_state->loadRom(no_game, 0, quirks);
+    chip8 = new Chip8();
+    return 0;
+}
+
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    chip8->restore(*initial_state);
+    if (!chip8->loadRom(data, size, quirks)) {
+        return 0;
+    }
+
+    unsigned int cycles = 0;
+    unsigned int frame_cycles = 0;
+    unsigned int frame = 0;
+    while (cycles < FUZZ_MAX_CYCLES) {
+        unsigned short pc = chip8->pc;
+        unsigned int retired = chip8->execute();
+        if (retired == 0) {
+            break; // faulted
+        }
+        pc_coverage[pc & chip8->ramMask()]++;
+        opcode_coverage[(chip8->opcode & 0xF000) >> 4 | (chip8->opcode & 0x00FF)]++;
+
+        cycles += retired;
+        frame_cycles += retired;
+        if (frame_cycles >= FUZZ_CYCLES_PER_FRAME) {
+            frame_cycles -= FUZZ_CYCLES_PER_FRAME;
+            chip8->tickTimers();
+
+            // walk one key at a time so key driven paths get reached too
+            frame++;
+            for (int i=0; i<16; i++) {
+                chip8->keys[i] = (frame / 4) % 16 == (unsigned int)i;
+            }
+        }
+    }
+
+    return 0;
+}
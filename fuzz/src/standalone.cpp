@@ -0,0 +1,26 @@
+// Replays inputs through the fuzz target when libFuzzer isn't available,
+// e.g. to reproduce a crash under gcc's sanitizers:
+//
+//   ./bin/fuzz_chip8 crash-1234 ../games/*
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include <fstream>
+
+extern "C" int LLVMFuzzerInitialize(int* argc, char*** argv);
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+
+
+int main(int argc, char* argv[]) {
+    LLVMFuzzerInitialize(&argc, &argv);
+
+    for (int i=1; i<argc; i++) {
+        std::ifstream fin(argv[i], std::ios::binary);
+        std::vector<uint8_t> input((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+        printf("Running %s (%d bytes)\n", argv[i], (int)input.size());
+        LLVMFuzzerTestOneInput(input.data(), input.size());
+    }
+
+    return 0;
+}
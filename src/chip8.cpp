@@ -1,5 +1,117 @@
+#include <stdio.h>
+#include <math.h>
+#include <fstream>
+#include <thread>
+#include <type_traits>
 #include "chip8.h"
 
+// copied a byte at a time, up to the end of the profile's memory
+static_assert(std::is_trivially_copyable<Chip8>::value, "Chip8 must be trivially copyable");
+
+
+// Zobrist style keys for the incremental state hash: memory and screen
+// hashes are the XOR of one key per non zero byte and per non zero display
+// word, so a write only has to swap the old key for the new one.
+static inline unsigned long long mix64(unsigned long long x) {
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    x ^= x >> 31;
+    return x;
+}
+
+static inline unsigned long long ramKey(unsigned int address, unsigned char value) {
+    return value ? mix64((unsigned long long)address << 8 | value) : 0;
+}
+
+struct DisplaySalts {
+    unsigned long long salt[Chip8::DISPLAY_PLANES*Chip8::DISPLAY_HEIGHT*2];
+    DisplaySalts() {
+        for (int i=0; i<Chip8::DISPLAY_PLANES*Chip8::DISPLAY_HEIGHT*2; i++) {
+            salt[i] = mix64(0x100000ULL + i);
+        }
+    }
+};
+
+// word is the index of the display word, (plane*DISPLAY_HEIGHT + row)*2 +
+// word in the row
+static inline unsigned long long displayKey(unsigned int word, unsigned long long bits) {
+    static DisplaySalts salts;
+    return bits ? mix64(bits ^ salts.salt[word]) : 0;
+}
+
+// Sprite rows are placed on the screen by rotating them (wrapping) or
+// shifting them (clipping) along a whole row: 64 bits in low resolution, 128
+// in high resolution
+static inline unsigned long long rotr(unsigned long long bits, unsigned int n) {
+    return (bits >> (n & 63)) | (bits << ((64 - n) & 63));
+}
+
+static inline unsigned __int128 rotr128(unsigned __int128 bits, unsigned int n) {
+    return (bits >> (n & 127)) | (bits << ((128 - n) & 127));
+}
+
+
+// Hexadecimal digit sprites, at the start of memory (see Fx29)
+static constexpr unsigned char font[80] = {
+    0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
+    0x20, 0x60, 0x20, 0x20, 0x70, // 1
+    0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
+    0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
+    0x90, 0x90, 0xF0, 0x10, 0x10, // 4
+    0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
+    0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
+    0xF0, 0x10, 0x20, 0x40, 0x40, // 7
+    0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
+    0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
+    0xF0, 0x90, 0xF0, 0x90, 0x90, // A
+    0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
+    0xF0, 0x80, 0x80, 0x80, 0xF0, // C
+    0xE0, 0x90, 0x90, 0x90, 0xE0, // D
+    0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
+    0xF0, 0x80, 0xF0, 0x80, 0x80  // F
+};
+
+// 8x10 digits for SUPER-CHIP's high resolution, right after the small ones
+// (see Fx30)
+#define BIG_FONT_ADDRESS 80
+static constexpr unsigned char big_font[160] = {
+    0x3C, 0x7E, 0xE7, 0xC3, 0xC3, 0xC3, 0xC3, 0xE7, 0x7E, 0x3C, // 0
+    0x18, 0x38, 0x58, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x3C, // 1
+    0x3E, 0x7F, 0xC3, 0x06, 0x0C, 0x18, 0x30, 0x60, 0xFF, 0xFF, // 2
+    0x3C, 0x7E, 0xC3, 0x03, 0x0E, 0x0E, 0x03, 0xC3, 0x7E, 0x3C, // 3
+    0x06, 0x0E, 0x1E, 0x36, 0x66, 0xC6, 0xFF, 0xFF, 0x06, 0x06, // 4
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFC, 0xFE, 0x03, 0xC3, 0x7E, 0x3C, // 5
+    0x3E, 0x7C, 0xE0, 0xC0, 0xFC, 0xFE, 0xC3, 0xC3, 0x7E, 0x3C, // 6
+    0xFF, 0xFF, 0x03, 0x06, 0x0C, 0x18, 0x30, 0x60, 0x60, 0x60, // 7
+    0x3C, 0x7E, 0xC3, 0xC3, 0x7E, 0x7E, 0xC3, 0xC3, 0x7E, 0x3C, // 8
+    0x3C, 0x7E, 0xC3, 0xC3, 0x7F, 0x3F, 0x03, 0x03, 0x3E, 0x7C, // 9
+    0x3C, 0x7E, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, // A
+    0xFC, 0xFE, 0xC3, 0xC3, 0xFE, 0xFE, 0xC3, 0xC3, 0xFE, 0xFC, // B
+    0x3C, 0x7E, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0x7E, 0x3C, // C
+    0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFC, 0xFC, 0xC0, 0xC0, 0xFF, 0xFF, // E
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFC, 0xFC, 0xC0, 0xC0, 0xC0, 0xC0  // F
+};
+
+
+// indexed by Chip8Quirks
+static unsigned int (Chip8::* const execute_table[QUIRKS_COUNT])() = {
+    &Chip8::executeQuirks<QuirksChip8>,
+    &Chip8::executeQuirks<QuirksCosmac>,
+    &Chip8::executeQuirks<QuirksSchip>,
+    &Chip8::executeQuirks<QuirksXochip>,
+};
+
+// the same, with the debugger checks
+static unsigned int (Chip8::* const execute_debug_table[QUIRKS_COUNT])() = {
+    &Chip8::executeQuirks<Debugging<QuirksChip8> >,
+    &Chip8::executeQuirks<Debugging<QuirksCosmac> >,
+    &Chip8::executeQuirks<Debugging<QuirksSchip> >,
+    &Chip8::executeQuirks<Debugging<QuirksXochip> >,
+};
+
 
 Chip8::Chip8() {
     clock  = 500; 
@@ -8,71 +120,128 @@ Chip8::Chip8() {
     I      = 0;
     stack_pointer   = 0;
     display_updated = true;
+    superinstructions = true;
+    step_cycles     = 1;
+    instructions    = 0;
+    frames          = 0;
+    draws           = 0;
+    key_waits       = 0;
+    write_frames    = NULL;
+    cycle_credit    = 0;
+    fault.pc        = 0;
+    fault.opcode    = 0;
+    quirks          = QUIRKS_CHIP8;
+    debug_flags     = NULL;
+    debug_flag_count = 0;
+    debug_break.active = false;
+    debug_resume    = false;
+    clearFault();
 
     sound_timer = 0;
     delay_timer = 0;
     game_max_address = 81;
 
-    unsigned char font_aux[80] = { 
-      0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
-      0x20, 0x60, 0x20, 0x20, 0x70, // 1
-      0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
-      0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
-      0x90, 0x90, 0xF0, 0x10, 0x10, // 4
-      0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
-      0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
-      0xF0, 0x10, 0x20, 0x40, 0x40, // 7
-      0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
-      0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
-      0xF0, 0x90, 0xF0, 0x90, 0x90, // A
-      0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
-      0xF0, 0x80, 0x80, 0x80, 0xF0, // C
-      0xE0, 0x90, 0x90, 0x90, 0xE0, // D
-      0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
-      0xF0, 0x80, 0xF0, 0x80, 0x80  // F
-    };
-
-    for (int i=0; i<4096; i++) {
-        ram[i] = 0;
-    }
-
-    for (int i=0; i<80; i++) {
-        ram[i] = font_aux[i];
-    }
+    memset(ram, 0, sizeof(ram));
+    memcpy(ram, font, sizeof(font));
+    memcpy(&ram[BIG_FONT_ADDRESS], big_font, sizeof(big_font));
+    memset(stack, 0, sizeof(stack));
+    memset(rpl, 0, sizeof(rpl));
 
     for (int i=0; i<16; i++) {
         V[i]    = 0;
         keys[i] = 0;
     }
 
-    for (int i=0; i<32; i++) {
-        for (int j=0; j<64; j++) {
-            display[i][j] = 0;
-        }
+    memset(display, 0, sizeof(display));
+    hires = false;
+    planes = 1;
+
+    // a 250Hz square wave until the game loads a pattern
+    for (int i=0; i<16; i++) {
+        audio_pattern[i] = i % 2 ? 0x00 : 0xFF;
     }
+    pitch = 64;
 
+    rehash();
 
     last_fetch = std::chrono::high_resolution_clock::now();
     last_timer = std::chrono::high_resolution_clock::now();
 
-    srand(42);
+    seed(42);
 };
 
 
-bool Chip8::loadGame(const char* fileName) {
+// Copies another machine over this one, only as far as the end of its
+// profile's memory: 4KB games copy 4KB, not the 64KB ram has room for
+void Chip8::restore(const Chip8& from) {
+    memcpy((void*)this, &from, from.stateSize());
+}
+
+
+void Chip8::setQuirks(Chip8Quirks profile) {
+    quirks = profile;
+    selectExecute();
+}
+
+
+// Each machine has its own random number generator, so instances are
+// reproducible and don't disturb each other, wherever they run.
+void Chip8::seed(unsigned int value) {
+    rng_state = ((value ^ 0x6D2B79F5) * 0x9E3779B1) | 1; // xorshift never leaves 0
+}
+
+
+// xorshift32, returning the high byte
+inline unsigned char Chip8::random() {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state >> 24;
+}
+
+
+bool Chip8::loadGame(const char* fileName, Chip8Quirks profile) {
     printf("Loading game %s\n", fileName);
 
     std::ifstream fin(fileName, std::ios::binary|std::ios::ate);
     std::ifstream::pos_type pos = fin.tellg();
     int length = pos;
     fin.seekg(0, std::ios::beg);
-    if (length > 4096-512) {
+    if (length < 0 || length > (int)memorySize(profile)-512) {
         return false;
     }
-    game_max_address = 512+length;
 
+    // straight into ram, a 64KB buffer on the stack is too much for threads
+    game_max_address = 512+length;
+    if (profile != quirks) {
+        setQuirks(profile);
+    }
     fin.read((char*)&ram[512], length);
+    rehash();
+    return true;
+}
+
+
+// Loads a game already in memory, for embedders and the fuzzer. Anything
+// goes as long as it fits after the interpreter area, in the profile's memory.
+// On a machine already set to the profile, e.g. a copy of a blank template,
+// only the game's bytes are folded into the hash instead of hashing it all.
+bool Chip8::loadRom(const unsigned char* data, size_t length, Chip8Quirks profile) {
+    if (length > memorySize(profile)-512) {
+        return false;
+    }
+    game_max_address = 512+length;
+    if (profile != quirks) {
+        setQuirks(profile);
+        memcpy(&ram[512], data, length);
+        rehash();
+        return true;
+    }
 
+    for (size_t i=0; i<length; i++) {
+        ram_hash ^= ramKey(512+i, ram[512+i]) ^ ramKey(512+i, data[i]);
+    }
+    memcpy(&ram[512], data, length);
     return true;
 }
 
@@ -85,325 +254,913 @@ void Chip8::runStep() {
 
     // update timers
     if ((float)ellapsed_timer.count() >= 1000000.0/60.0) {
-        if (sound_timer > 0) {
-            sound_timer--;
-        }
-        if (delay_timer > 0) {
-            delay_timer--;
-        }
+        tickTimers();
     }
 
-    // sleep according to the clock
-    float time_to_sleep = (1000.0/clock)*1000 - (float)ellapsed_fetch.count();
+    // sleep according to the clock, accounting for every instruction retired
+    // by the last step (superinstructions retire more than one)
+    float time_to_sleep = (1000.0/clock)*1000*step_cycles - (float)ellapsed_fetch.count();
     if (time_to_sleep > 0) {
         std::this_thread::sleep_for(std::chrono::microseconds(int(time_to_sleep)));
     }
 
-    // Fetch + run instruction
-    opcode = ram[pc] << 8 | ram[pc + 1];
-    if (pc >= game_max_address) {
-        printf("Invalid PC address: %d\n", (int)pc);
-        exit(1);
+    step_cycles = execute();
+}
+
+
+unsigned int Chip8::execute() {
+    unsigned int retired = (this->*execute_fn)();
+    instructions += retired;
+    return retired;
+}
+
+
+// Runs one 60Hz frame worth of instructions at the current clock, then ticks
+// the timers. Unlike runStep it never looks at the wall clock, so the same
+// game, seed and keys always produce the same frames. A debugger stop ends
+// it early without ticking, and the next call finishes the frame. Returns
+// the number of instructions retired.
+unsigned int Chip8::runFrame() {
+    unsigned int frame_instructions = 0;
+
+    // credit is kept in 1/60ths of an instruction so clocks that aren't a
+    // multiple of 60 still average out, and superinstructions that run past
+    // the end of the frame are paid back on the next one
+    cycle_credit += clock;
+    while (cycle_credit >= 60) {
+        unsigned int retired = execute();
+        cycle_credit -= 60 * (int)retired;
+        frame_instructions += retired;
+        if (debug_break.active) {
+            // the next call adds the clock back, leaving this frame's rest
+            cycle_credit -= clock;
+            return frame_instructions;
+        }
+        if (retired == 0) {
+            cycle_credit = 0; // faulted
+            break;
+        }
     }
-    // printf("OPCODE: %#06x\n", opcode);
+    tickTimers();
+    return frame_instructions;
+}
+
 
-    switch(opcode & 0xF000) {
-        case 0x0000: 
-            {
-                switch (opcode & 0x000F) {
-                    case 0x0000: // CLS
-                        for (int i=0; i<32; i++) {
-                            for (int j=0; j<64; j++) {
-                                display[i][j] = 0;
-                            }
-                        }
-                        display_updated = true;
-                        pc += 2;
-                        break;
-                    case 0x000E: // RET
-                        pc = stack[--stack_pointer];
-                        pc += 2;
-                        break;
-                    default:
-                        printf("Undefined OP Code");
-                        exit(1);
+void Chip8::tickTimers() {
+    frames++;
+    if (sound_timer > 0) {
+        sound_timer--;
+    }
+    if (delay_timer > 0) {
+        delay_timer--;
+    }
+}
+
+
+// 64 bit fingerprint of everything that decides how the machine carries on:
+// memory, screen, registers, stack, timers and random state. Keys are input,
+// not state, and aren't part of it. Two machines with the same hash will run
+// the same from here given the same keys.
+//
+// Memory and screen are hashed incrementally by the opcodes that write them,
+// the rest is a few dozen bytes hashed here, so this is O(1). Code writing to
+// ram or display directly must call rehash afterwards.
+unsigned long long Chip8::stateHash() const {
+    unsigned long long h = mix64(ram_hash ^ mix64(display_hash));
+    h = hashBytes(h, V, sizeof(V));
+    h = hashBytes(h, stack, sizeof(stack));
+    h = hashBytes(h, rpl, sizeof(rpl));
+    h = hashBytes(h, audio_pattern, sizeof(audio_pattern));
+
+    unsigned long long regs[3] = {
+        (unsigned long long)pc | (unsigned long long)I << 16 | (unsigned long long)stack_pointer << 32 | (unsigned long long)delay_timer << 48 | (unsigned long long)sound_timer << 56,
+        (unsigned long long)rng_state | (unsigned long long)(unsigned int)cycle_credit << 32,
+        (unsigned long long)quirks | (unsigned long long)hires << 8 | (unsigned long long)planes << 16 | (unsigned long long)pitch << 24,
+    };
+    return hashBytes(h, regs, sizeof(regs));
+}
+
+
+// Recomputes the memory and screen hashes from scratch
+void Chip8::rehash() {
+    ram_hash = 0;
+    for (unsigned int i=0; i<memorySize(); i++) {
+        ram_hash ^= ramKey(i, ram[i]);
+    }
+    rehashDisplay();
+}
+
+
+void Chip8::rehashDisplay() {
+    const unsigned long long* words = &display[0][0][0];
+    display_hash = 0;
+    for (int i=0; i<DISPLAY_PLANES*DISPLAY_HEIGHT*2; i++) {
+        display_hash ^= displayKey(i, words[i]);
+    }
+}
+
+
+// Screen writes made on behalf of the game: XORs bits into a display word,
+// keeping the state hash current. Returns true if any of them were lit.
+inline bool Chip8::flipPixels(int plane, int row, int word, unsigned long long bits) {
+    if (bits == 0) {
+        return false;
+    }
+    unsigned long long old = display[plane][row][word];
+    unsigned int index = (plane*DISPLAY_HEIGHT + row)*2 + word;
+    display[plane][row][word] = old ^ bits;
+    display_hash ^= displayKey(index, old) ^ displayKey(index, old ^ bits);
+    return (old & bits) != 0;
+}
+
+
+// Clears the planes in mask
+void Chip8::clearDisplay(unsigned char mask) {
+    if ((mask & ALL_PLANES) == ALL_PLANES) {
+        memset(display, 0, sizeof(display));
+        display_hash = 0;
+    } else {
+        for (int p=0; p<DISPLAY_PLANES; p++) {
+            if (mask & (1 << p)) {
+                memset(display[p], 0, sizeof(display[p]));
+            }
+        }
+        rehashDisplay();
+    }
+    display_updated = true;
+}
+
+
+// Lights or clears a pixel directly, see rehash
+void Chip8::setPixel(int x, int y, bool on, int plane) {
+    unsigned long long bit = 1ULL << (63 - (x & 63));
+    if (on) {
+        display[plane][y][x >> 6] |= bit;
+    } else {
+        display[plane][y][x >> 6] &= ~bit;
+    }
+}
+
+
+// Memory writes made on behalf of the game, keeping the state hash current.
+// The address must be masked into the profile's memory already.
+inline void Chip8::store(unsigned short address, unsigned char value) {
+    ram_hash ^= ramKey(address, ram[address]) ^ ramKey(address, value);
+    ram[address] = value;
+    if (write_frames) {
+        write_frames[address] = frames + 1;
+    }
+}
+
+
+// A store from outside the game, e.g. the debugger's memory editor. Wraps
+// into the profile's memory and keeps the hash current like the game's own.
+void Chip8::poke(unsigned int address, unsigned char value) {
+    store(address & ramMask(), value);
+}
+
+
+// Word at a time multiply-xorshift mix, size must be a multiple of 8
+unsigned long long Chip8::hashBytes(unsigned long long h, const void* data, size_t size) {
+    const unsigned char* p = (const unsigned char*)data;
+    for (size_t i=0; i<size; i+=8) {
+        unsigned long long word = 0;
+        memcpy(&word, p + i, size - i < 8 ? size - i : 8);
+        h ^= word;
+        h *= 0xFF51AFD7ED558CCDULL;
+        h ^= h >> 32;
+    }
+    return h;
+}
+
+
+// Writes a plane of the screen at 64x32 with one bit per pixel, 8 bytes per
+// row, leftmost pixel in the most significant bit. In high resolution each
+// pixel is lit if any of the 2x2 it stands for is.
+void Chip8::packDisplay(unsigned char* out, int plane) const {
+    const unsigned long long (*rows)[DISPLAY_WIDTH/64] = display[plane];
+    for (int i=0; i<32; i++) {
+        unsigned long long row = rows[i][0];
+        if (hires) {
+            unsigned long long left = rows[2*i][0] | rows[2*i + 1][0];
+            unsigned long long right = rows[2*i][1] | rows[2*i + 1][1];
+            row = 0;
+            for (int j=0; j<32; j++) {
+                row |= (unsigned long long)((left >> (62 - 2*j)) & 3 ? 1 : 0) << (63 - j);
+                row |= (unsigned long long)((right >> (62 - 2*j)) & 3 ? 1 : 0) << (31 - j);
+            }
+        }
+        for (int j=0; j<8; j++) {
+            *out++ = row >> (56 - 8*j);
+        }
+    }
+}
+
+
+// Writes a plane of the screen at 128x64, 16 bytes per row, low resolution
+// pixels doubled both ways
+void Chip8::packHires(unsigned char* out, int plane) const {
+    const unsigned long long (*rows)[DISPLAY_WIDTH/64] = display[plane];
+    for (int i=0; i<DISPLAY_HEIGHT; i++) {
+        unsigned long long words[2] = { rows[i][0], rows[i][1] };
+        if (!hires) {
+            unsigned long long row = rows[i / 2][0];
+            words[0] = words[1] = 0;
+            for (int j=0; j<64; j++) {
+                unsigned long long on = (row >> (63 - j)) & 1;
+                words[j / 32] |= (on * 3) << (62 - 2*(j % 32));
+            }
+        }
+        for (int j=0; j<16; j++) {
+            *out++ = words[j / 8] >> (56 - 8*(j % 8));
+        }
+    }
+}
+
+
+// Samples per second of the XO-CHIP audio pattern
+float Chip8::audioRate() const {
+    return 4000.0f * powf(2.0f, (pitch - 64) / 48.0f);
+}
+
+
+// Stands in for execute while the machine is faulted, so a bad game costs
+// nothing to the instances around it and nothing to the hot path.
+unsigned int Chip8::executeFaulted() {
+    return 0;
+}
+
+
+// Records why execution stopped on the current instruction and parks the
+// machine until clearFault. Returns the number of instructions retired (none),
+// so opcode handlers can return it directly.
+unsigned int Chip8::raiseFault(const char* reason) {
+    fault.active = true;
+    fault.pc     = pc;
+    fault.opcode = opcode;
+    fault.reason = reason;
+    execute_fn   = &Chip8::executeFaulted;
+    return 0;
+}
+
+
+void Chip8::clearFault() {
+    fault.active = false;
+    fault.reason = "";
+    selectExecute();
+}
+
+
+// Picks the execute for the current quirks, with the debugger checks only
+// when some debugger flag is set
+void Chip8::selectExecute() {
+    if (fault.active) {
+        execute_fn = &Chip8::executeFaulted;
+    } else if (debug_flag_count > 0) {
+        execute_fn = execute_debug_table[quirks];
+    } else {
+        execute_fn = execute_table[quirks];
+    }
+}
+
+
+// Replaces the debugger flags of an address. debug_flags must be set.
+void Chip8::setDebugFlags(unsigned short address, unsigned char flags) {
+    address &= ramMask();
+    debug_flag_count += (flags != 0) - (debug_flags[address] != 0);
+    debug_flags[address] = flags;
+    selectExecute();
+}
+
+
+// Removes the given flags from every address
+void Chip8::clearDebugFlags(unsigned char flags) {
+    if (!debug_flags) {
+        return;
+    }
+    for (unsigned int i=0; i<memorySize(); i++) {
+        if (debug_flags[i] & flags) {
+            setDebugFlags(i, debug_flags[i] & ~flags);
+        }
+    }
+}
+
+
+// Carries on after a debugger stop, running the instruction it stopped on
+void Chip8::resume() {
+    debug_break.active = false;
+    debug_resume = true;
+}
+
+
+// Runs exactly one instruction, not fused with the next and ignoring the
+// debugger flags on it. Returns the instructions retired (0 if faulted).
+unsigned int Chip8::step() {
+    if (fault.active) {
+        return 0;
+    }
+    debug_break.active = false;
+    debug_resume = true;
+    // through a named copy: calling the table entry directly makes GCC 12
+    // warn that its temporary may be used uninitialised under ASan
+    unsigned int (Chip8::* const execute_once)() = execute_debug_table[quirks];
+    unsigned int retired = (this->*execute_once)();
+    instructions += retired;
+    debug_resume = false;
+    return retired;
+}
+
+
+// Checks the instruction at pc against the debugger flags, before it runs,
+// without changing anything. Memory watches cover what the instruction is
+// going to touch: Dxyn and Fx65 read from I, Fx33 and Fx55 write there, and
+// on XO-CHIP F002 and 5xy3 read from I, 5xy2 writes there.
+// Returns the flag hit (0 if none) and the address it is on.
+unsigned char Chip8::debugHit(unsigned short& address) const {
+    if (!debug_flags) {
+        return 0;
+    }
+    const unsigned int mask = ramMask();
+    unsigned char flags = debug_flags[pc & mask];
+    if (flags & (DEBUG_BREAK | DEBUG_CURSOR)) {
+        address = pc;
+        return flags & DEBUG_BREAK ? DEBUG_BREAK : DEBUG_CURSOR;
+    }
+
+    unsigned short next = ram[pc & mask] << 8 | ram[(pc + 1) & mask];
+    unsigned char watch = 0;
+    unsigned int length = 0;
+    switch (next & 0xF0FF) {
+        case 0xF033: watch = DEBUG_WRITE; length = 3; break;
+        case 0xF055: watch = DEBUG_WRITE; length = ((next & 0x0F00) >> 8) + 1; break;
+        case 0xF065: watch = DEBUG_READ;  length = ((next & 0x0F00) >> 8) + 1; break;
+        default:
+            if ((next & 0xF000) == 0xD000) {
+                watch = DEBUG_READ;
+                length = next & 0x000F;
+                if (length == 0 && (quirks == QUIRKS_SCHIP || quirks == QUIRKS_XOCHIP)) {
+                    length = 32; // 16x16 sprite
+                }
+                if (quirks == QUIRKS_XOCHIP) {
+                    length *= __builtin_popcount(planes); // a sprite per plane
                 }
+            } else if (quirks == QUIRKS_XOCHIP && next == 0xF002) {
+                watch = DEBUG_READ;
+                length = 16;
+            } else if (quirks == QUIRKS_XOCHIP && ((next & 0xF00F) == 0x5002 || (next & 0xF00F) == 0x5003)) {
+                int x = (next & 0x0F00) >> 8, y = (next & 0x00F0) >> 4;
+                watch = (next & 0x000F) == 2 ? DEBUG_WRITE : DEBUG_READ;
+                length = (x > y ? x - y : y - x) + 1;
             }
             break;
-        
-        case 0x1000: // 1nnn - JP addr
-            pc = opcode & 0x0FFF;
-            break;
-        
-        case 0x2000: // 2nnn - CALL addr
-            stack[stack_pointer] = pc;
-            ++stack_pointer;
-            pc = opcode & 0x0FFF;
-            break;
+    }
+    for (unsigned int i=0; i<length; i++) {
+        if (debug_flags[(I + i) & mask] & watch) {
+            address = (I + i) & mask;
+            return watch;
+        }
+    }
+    return 0;
+}
+
+
+// Stops the machine if the instruction at pc hits a debugger flag
+bool Chip8::debugStop() {
+    unsigned short address = 0;
+    unsigned char reason = debugHit(address);
+    if (reason == 0) {
+        return false;
+    }
+    if (reason == DEBUG_CURSOR) {
+        clearDebugFlags(DEBUG_CURSOR);
+    }
+    debug_break.active  = true;
+    debug_break.pc      = pc;
+    debug_break.address = address;
+    debug_break.reason  = reason;
+    return true;
+}
 
-        case 0x3000: // 3xkk - SE Vx, byte
-            if (V[(opcode & 0x0F00)>>8] == (opcode & 0x00FF)) {
+
+// Returns true if the instruction at pc can be fused into the one currently
+// being executed, i.e. superinstructions are enabled, pc is valid and the
+// opcode there starts with the given high byte (masked by high_mask). Never
+// while debugging, so every instruction can be stopped on.
+template <class Q>
+inline bool Chip8::fusable(unsigned char high, unsigned char high_mask) {
+    return !Q::debug && superinstructions && pc < game_max_address && (ram[pc] & high_mask) == high;
+}
+
+
+// Conditional skips are followed by a JP on most ROMs (the only way to get a
+// conditional branch on the CHIP-8), so skip + 1nnn runs as one conditional
+// jump. pc must point at the skip instruction. Returns the instructions retired.
+// On XO-CHIP skipping F000 nnnn skips all 4 bytes of it.
+template <class Q>
+inline unsigned int Chip8::skipIf(bool condition) {
+    if (condition) {
+        if constexpr (Q::xochip) {
+            if (ram[(pc + 2) & Q::ram_mask] == 0xF0 && ram[(pc + 3) & Q::ram_mask] == 0x00) {
                 pc += 2;
             }
-            pc += 2;
-            break;
+        }
+        pc += 4;
+        return 1;
+    }
+    pc += 2;
+    if (fusable<Q>(0x10, 0xF0)) {
+        pc = (ram[pc] & 0x0F) << 8 | ram[(pc + 1) & Q::ram_mask];
+        return 2;
+    }
+    return 1;
+}
 
-        case 0x4000: // 4xkk - SNE Vx, byte
-            if (V[(opcode & 0x0F00) >> 8] != (opcode & 0x00FF)) {
-                pc += 2;
+
+// The sprite origin always wraps around the screen, the quirk decides what
+// happens to the pixels that go past the right and bottom edges. Each sprite
+// row is shifted into place in the packed display words and XORed in whole.
+// SUPER-CHIP draws 16x16 sprites, two bytes a row, for Dxy0. XO-CHIP draws
+// on every selected plane, each with its own sprite, one after the other.
+template <class Q>
+void Chip8::draw(unsigned char x, unsigned char y, unsigned char height) {
+    const bool wide = Q::schip && height == 0;
+    const bool high = Q::schip && hires;
+    const int width = high ? 128 : 64;
+    const int rows = high ? 64 : 32;
+    draws++;
+    const unsigned char mask = Q::xochip ? planes : 1;
+    unsigned short sprite = I;
+    bool collision = false;
+
+    if (wide) {
+        height = 16;
+    }
+    x &= width - 1;
+    y &= rows - 1;
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++) {
+        if (!(mask & (1 << plane))) {
+            continue;
+        }
+        for (int yline = 0; yline < height; yline++) {
+            int row = y + yline;
+            if (Q::clip_sprites && row >= rows) {
+                break;
             }
-            pc += 2;
-            break;
-        
-        case 0x5000: // 5xy0 - SE Vx, Vy
-            if (V[(opcode & 0x0F00) >> 8] == V[(opcode & 0x00F0) >> 4]) {
-                pc += 2;
+            row &= rows - 1;
+
+            unsigned long long bits;
+            if (wide) {
+                bits = (unsigned long long)(ram[(sprite + 2*yline) & Q::ram_mask] << 8 | ram[(sprite + 2*yline + 1) & Q::ram_mask]) << 48;
+            } else {
+                bits = (unsigned long long)ram[(sprite + yline) & Q::ram_mask] << 56;
             }
-            pc += 2;
-            break;
-        
-        case 0x6000: // 6xkk - LD Vx, byte 
-            V[(opcode & 0x0F00) >> 8] = opcode & 0x00FF;
-            pc += 2;
-            break;
-        
-        case 0x7000: // 7xkk - ADD Vx, byte 
-            V[(opcode & 0x0F00) >> 8] += (opcode & 0x00FF);
-            pc += 2;
-            break;
 
-        case 0x8000:
-            switch (opcode & 0x000F) {
-                case 0x0000: // 8xy0 - LD Vx, Vy
-                    V[(opcode & 0x0F00) >> 8] = V[(opcode & 0x00F0) >> 4];
-                    pc += 2;
-                    break;
-
-                case 0x0001: // 8xy1 - OR Vx, Vy
-                    V[(opcode & 0x0F00) >> 8] |= V[(opcode & 0x00F0) >> 4];
-                    pc += 2;
-                    break;
-
-                case 0x0002: // 8xy2 - AND Vx, Vy
-                    V[(opcode & 0x0F00) >> 8] = V[(opcode & 0x0F00) >> 8] & V[(opcode & 0x00F0) >> 4];
-                    pc += 2;
-                    break;
-                
-                case 0x0003: // 8xy3 - XOR Vx, Vy
-                    V[(opcode & 0x0F00) >> 8] ^= V[(opcode & 0x00F0) >> 4];
-                    pc += 2;
-                    break;
-
-                case 0x0004: // 8xy4 - ADD Vx, Vy
-                {
-                    unsigned char x = (opcode & 0x0F00) >> 8;
-                    unsigned char y = (opcode & 0x00F0) >> 4;
-                    if ((int)V[x] + (int)V[y] > 255) {
-                        V[0xF] = 1;
-                    } else {
-                        V[0xF] = 0;
-                    }
-                    V[x] += V[y];
-                    pc += 2;
-                }   
-                    break;
-
-                case 0x0005: // 8xy5 - SUB Vx, Vy
-                {
-                    unsigned char x = (opcode & 0x0F00) >> 8;
-                    unsigned char y = (opcode & 0x00F0) >> 4;
-                    if (V[x] > V[y]) {
-                        V[0xF] = 1;
-                    } else {
-                        V[0xF] = 0;
+            if (!high) {
+                collision |= flipPixels(plane, row, 0, Q::clip_sprites ? bits >> x : rotr(bits, x));
+            } else {
+                unsigned __int128 wide_bits = (unsigned __int128)bits << 64;
+                unsigned __int128 placed = Q::clip_sprites ? wide_bits >> x : rotr128(wide_bits, x);
+                collision |= flipPixels(plane, row, 0, (unsigned long long)(placed >> 64));
+                collision |= flipPixels(plane, row, 1, (unsigned long long)placed);
+            }
+        }
+        sprite += wide ? 32 : height;
+    }
+
+    V[0xF] = collision;
+    display_updated = true;
+}
+
+
+// Fetches and runs the instruction at pc, without any timing. The most common
+// opcode sequences found on the bundled games are fused into superinstructions
+// that run on a single dispatch (see fusable), so the return value is the
+// number of CHIP-8 instructions retired by this call.
+template <class Q>
+unsigned int Chip8::executeQuirks() {
+    opcode = ram[pc & Q::ram_mask] << 8 | ram[(pc + 1) & Q::ram_mask];
+    if (pc >= game_max_address) {
+        return raiseFault("pc outside of the loaded game");
+    }
+    // printf("OPCODE: %#06x\n", opcode);
+
+    if constexpr (Q::debug) {
+        if (!debug_resume && debugStop()) {
+            return 0;
+        }
+        debug_resume = false;
+    }
+
+    // handlers are specialised per opcode at compile time and inlined into
+    // dense switches, so decoding is a jump through a table per level
+    switch (opcode >> 12) {
+        case 0x0: return op<Q, 0x0>();
+        case 0x1: return op<Q, 0x1>();
+        case 0x2: return op<Q, 0x2>();
+        case 0x3: return op<Q, 0x3>();
+        case 0x4: return op<Q, 0x4>();
+        case 0x5: return op<Q, 0x5>();
+        case 0x6: return op<Q, 0x6>();
+        case 0x7: return op<Q, 0x7>();
+        case 0x8: return op<Q, 0x8>();
+        case 0x9: return op<Q, 0x9>();
+        case 0xA: return op<Q, 0xA>();
+        case 0xB: return op<Q, 0xB>();
+        case 0xC: return op<Q, 0xC>();
+        case 0xD: return op<Q, 0xD>();
+        case 0xE: return op<Q, 0xE>();
+        default:  return op<Q, 0xF>();
+    }
+}
+
+
+// Opcodes by their high nibble N. Each handler returns the instructions it
+// retired.
+template <class Q, unsigned N>
+unsigned int Chip8::op() {
+    if constexpr (N == 0x0) {
+        switch (opcode) {
+            case 0x00E0: // 00E0 - CLS
+                clearDisplay(Q::xochip ? planes : ALL_PLANES);
+                pc += 2;
+                break;
+            case 0x00EE: // 00EE - RET
+                stack_pointer = (stack_pointer - 1) & STACK_MASK;
+                pc = stack[stack_pointer];
+                pc += 2;
+                break;
+            default:
+                if constexpr (Q::schip) {
+                    if ((opcode & 0xFFF0) == 0x00C0 || (opcode >= 0x00FB && opcode <= 0x00FF)) {
+                        return opSuper();
                     }
-                    V[x] = V[x] - V[y];
-                    pc += 2;
-                }   
-                    break;
-
-                case 0x0006: // 8xy6 - SHR Vx {, Vy}
-                    V[0xF] = V[(opcode & 0x0F00) >> 8] & 0x01;
-                    V[(opcode & 0x0F00) >> 8] /= 2;
-
-                    pc += 2;
-                    break;
-
-                case 0x0007: // 8xy7 - SUBN Vx, Vy
-                {
-                    unsigned char x = (opcode & 0x0F00) >> 8;
-                    unsigned char y = (opcode & 0x00F0) >> 4;
-                    if (V[y] > V[x]) {
-                        V[0xF] = 1;
-                    } else {
-                        V[0xF] = 0;
+                }
+                if constexpr (Q::xochip) {
+                    if ((opcode & 0xFFF0) == 0x00D0) {
+                        return opSuper();
                     }
-                    V[x] = V[y] - V[x];
-                    pc += 2;
-                }   
-                    break;
-
-                case 0x000E: // 8xyE - SHL Vx {, Vy}
-                {
-                    unsigned char vx = V[(opcode & 0x0F00) >> 8];
-                    V[0xF] = vx >> 7;
-                    V[(opcode & 0x0F00) >> 8] = vx*2;
-                    pc += 2;
                 }
-                    break;
+                // 0nnn - SYS addr, only meaningful on the original hardware
+                pc += 2;
+                break;
+        }
+        return 1;
 
-                default:
-                    printf("Operation not implemented\n");
-                    exit(1);
-                    break;
-            }
+    } else if constexpr (N == 0x1) { // 1nnn - JP addr
+        pc = opcode & 0x0FFF;
+        return 1;
 
-            break;
+    } else if constexpr (N == 0x2) { // 2nnn - CALL addr
+        stack[stack_pointer & STACK_MASK] = pc;
+        stack_pointer = (stack_pointer + 1) & STACK_MASK;
+        pc = opcode & 0x0FFF;
+        return 1;
+
+    } else if constexpr (N == 0x3) { // 3xkk - SE Vx, byte
+        return skipIf<Q>(V[(opcode & 0x0F00)>>8] == (opcode & 0x00FF));
+
+    } else if constexpr (N == 0x4) { // 4xkk - SNE Vx, byte
+        return skipIf<Q>(V[(opcode & 0x0F00) >> 8] != (opcode & 0x00FF));
 
-        case 0x9000: // 9xy0 - SNE Vx, Vy
-            if (V[(opcode&0x0F00) >> 8] != V[(opcode & 0x00F0)>>4]) {
-               pc += 2; 
+    } else if constexpr (N == 0x5) { // 5xy0 - SE Vx, Vy
+        if constexpr (Q::xochip) {
+            // 5xy2 - LD [I], Vx-Vy and 5xy3 - LD Vx-Vy, [I], in either
+            // direction, leaving I alone
+            int x = (opcode & 0x0F00) >> 8, y = (opcode & 0x00F0) >> 4;
+            int step = x <= y ? 1 : -1;
+            int count = (x <= y ? y - x : x - y) + 1;
+            if ((opcode & 0x000F) == 0x2) {
+                for (int i=0; i<count; i++) {
+                    store((I + i) & Q::ram_mask, V[x + step*i]);
+                }
+                pc += 2;
+                return 1;
+            } else if ((opcode & 0x000F) == 0x3) {
+                for (int i=0; i<count; i++) {
+                    V[x + step*i] = ram[(I + i) & Q::ram_mask];
+                }
+                pc += 2;
+                return 1;
             }
-            pc += 2;
-            break;
+        }
+        return skipIf<Q>(V[(opcode & 0x0F00) >> 8] == V[(opcode & 0x00F0) >> 4]);
 
-        case 0xA000: // Annn - LD I, addr
-            I = opcode & 0x0FFF;
+    } else if constexpr (N == 0x6) { // 6xkk - LD Vx, byte
+        V[(opcode & 0x0F00) >> 8] = opcode & 0x00FF;
+        pc += 2;
+        // 6xkk + 6xkk: loading sprite coordinates and the like
+        if (fusable<Q>(0x60, 0xF0)) {
+            V[ram[pc] & 0x0F] = ram[(pc + 1) & Q::ram_mask];
             pc += 2;
-            break;
-        
-        case 0xC000: // Cxkk - RND Vx, byte
-        {
-            unsigned short rand_number = rand()%256;
-            V[(opcode & 0x0F00) >> 8] = (opcode & 0x00FF) & rand_number;
+            return 2;
+        }
+        return 1;
+
+    } else if constexpr (N == 0x7) { // 7xkk - ADD Vx, byte
+        V[(opcode & 0x0F00) >> 8] += (opcode & 0x00FF);
+        pc += 2;
+        return 1;
+
+    } else if constexpr (N == 0x8) {
+        switch (opcode & 0x000F) {
+            case 0x0: return opAlu<Q, 0x0>();
+            case 0x1: return opAlu<Q, 0x1>();
+            case 0x2: return opAlu<Q, 0x2>();
+            case 0x3: return opAlu<Q, 0x3>();
+            case 0x4: return opAlu<Q, 0x4>();
+            case 0x5: return opAlu<Q, 0x5>();
+            case 0x6: return opAlu<Q, 0x6>();
+            case 0x7: return opAlu<Q, 0x7>();
+            case 0xE: return opAlu<Q, 0xE>();
+            default:  return opAlu<Q, 0xF>();
+        }
+
+    } else if constexpr (N == 0x9) { // 9xy0 - SNE Vx, Vy
+        return skipIf<Q>(V[(opcode&0x0F00) >> 8] != V[(opcode & 0x00F0)>>4]);
+
+    } else if constexpr (N == 0xA) { // Annn - LD I, addr
+        I = opcode & 0x0FFF;
+        pc += 2;
+        // Annn + Dxyn: point I to a sprite and draw it
+        if (fusable<Q>(0xD0, 0xF0)) {
+            opcode = ram[pc] << 8 | ram[(pc + 1) & Q::ram_mask];
+            draw<Q>(V[(opcode & 0x0F00) >> 8], V[(opcode & 0x00F0) >> 4], opcode & 0x000F);
             pc += 2;
+            return 2;
         }
-            break;
-        
-        case 0xD000: // Dxyn - DRW Vx, Vy, nibble
-        {
-            unsigned short x = V[(opcode & 0x0F00) >> 8];
-            unsigned short y = V[(opcode & 0x00F0) >> 4];
-            unsigned short height = opcode & 0x000F;
-            unsigned short pixel;
-            
+        return 1;
+
+    } else if constexpr (N == 0xB) { // Bnnn - JP V0, addr (Bxnn - JP Vx, addr on SUPER-CHIP)
+        if constexpr (Q::jump_vx) {
+            pc = (opcode & 0x0FFF) + V[(opcode & 0x0F00) >> 8];
+        } else {
+            pc = (opcode & 0x0FFF) + V[0];
+        }
+        return 1;
+
+    } else if constexpr (N == 0xC) { // Cxkk - RND Vx, byte
+        V[(opcode & 0x0F00) >> 8] = (opcode & 0x00FF) & random();
+        pc += 2;
+        return 1;
+
+    } else if constexpr (N == 0xD) { // Dxyn - DRW Vx, Vy, nibble
+        draw<Q>(V[(opcode & 0x0F00) >> 8], V[(opcode & 0x00F0) >> 4], opcode & 0x000F);
+        pc += 2;
+        return 1;
+
+    } else if constexpr (N == 0xE) {
+        switch (opcode & 0x00FF) {
+            case 0x009E: // Ex9E - SKP Vx
+                return skipIf<Q>(keys[V[(opcode & 0x0F00)>>8] & 0x0F] != 0);
+            case 0x00A1: // ExA1 - SKNP Vx
+                return skipIf<Q>(keys[V[(opcode & 0x0F00)>>8] & 0x0F] == 0);
+            default:
+                return raiseFault("unknown Ex__ opcode");
+        }
+
+    } else {
+        switch (opcode & 0x00FF) {
+            case 0x00: return opMisc<Q, 0x00>();
+            case 0x01: return opMisc<Q, 0x01>();
+            case 0x02: return opMisc<Q, 0x02>();
+            case 0x07: return opMisc<Q, 0x07>();
+            case 0x0A: return opMisc<Q, 0x0A>();
+            case 0x15: return opMisc<Q, 0x15>();
+            case 0x18: return opMisc<Q, 0x18>();
+            case 0x1E: return opMisc<Q, 0x1E>();
+            case 0x29: return opMisc<Q, 0x29>();
+            case 0x30: return opMisc<Q, 0x30>();
+            case 0x33: return opMisc<Q, 0x33>();
+            case 0x3A: return opMisc<Q, 0x3A>();
+            case 0x55: return opMisc<Q, 0x55>();
+            case 0x65: return opMisc<Q, 0x65>();
+            case 0x75: return opMisc<Q, 0x75>();
+            case 0x85: return opMisc<Q, 0x85>();
+            default:   return opMisc<Q, 0xFF>();
+        }
+    }
+}
+
+
+// 8xyN, the arithmetic and logic opcodes
+template <class Q, unsigned N>
+unsigned int Chip8::opAlu() {
+    unsigned char x = (opcode & 0x0F00) >> 8;
+    unsigned char y = (opcode & 0x00F0) >> 4;
+
+    if constexpr (N == 0x0) { // 8xy0 - LD Vx, Vy
+        V[x] = V[y];
+
+    } else if constexpr (N == 0x1) { // 8xy1 - OR Vx, Vy
+        V[x] |= V[y];
+        if constexpr (Q::vf_reset) {
             V[0xF] = 0;
-            for (int yline = 0; yline < height; yline++) {
-                pixel = ram[I + yline];
-                for(int xline = 0; xline < 8; xline++) {
-                    if((pixel & (0x80 >> xline)) != 0) {
-                        if(display[y + yline][x + xline] == 1)
-                            V[0xF] = 1;                                 
-                        display[y + yline][x + xline] ^= 1;
-                    }
-                }
-            }
+        }
 
-            display_updated = true;
-            pc += 2;
+    } else if constexpr (N == 0x2) { // 8xy2 - AND Vx, Vy
+        V[x] &= V[y];
+        if constexpr (Q::vf_reset) {
+            V[0xF] = 0;
         }
-        break;
 
-        case 0xE000: 
-            switch (opcode & 0x00F0) {
-                case 0x0090: // Ex9E - SKP Vx
-                    if (keys[V[(opcode & 0x0F00)>>8]] != 0) {
-                       pc += 2;
-                    }
-                    pc += 2; 
-                    break;
-                case 0x00A0: // ExA1 - SKNP Vx
-                    if (keys[V[(opcode & 0x0F00)>>8]] == 0) {
-                       pc += 2;
-                    }
-                    pc += 2; 
-                    break;
-                default:
-                    printf("Invalid operation\n");
-                    exit(1);
+    } else if constexpr (N == 0x3) { // 8xy3 - XOR Vx, Vy
+        V[x] ^= V[y];
+        if constexpr (Q::vf_reset) {
+            V[0xF] = 0;
+        }
+
+    } else if constexpr (N == 0x4) { // 8xy4 - ADD Vx, Vy
+        if ((int)V[x] + (int)V[y] > 255) {
+            V[0xF] = 1;
+        } else {
+            V[0xF] = 0;
+        }
+        V[x] += V[y];
+
+    } else if constexpr (N == 0x5) { // 8xy5 - SUB Vx, Vy
+        if (V[x] > V[y]) {
+            V[0xF] = 1;
+        } else {
+            V[0xF] = 0;
+        }
+        V[x] = V[x] - V[y];
+
+    } else if constexpr (N == 0x6) { // 8xy6 - SHR Vx {, Vy}
+        unsigned char src = Q::shift_vy ? V[y] : V[x];
+        V[x] = src / 2;
+        V[0xF] = src & 0x01;
+
+    } else if constexpr (N == 0x7) { // 8xy7 - SUBN Vx, Vy
+        if (V[y] > V[x]) {
+            V[0xF] = 1;
+        } else {
+            V[0xF] = 0;
+        }
+        V[x] = V[y] - V[x];
+
+    } else if constexpr (N == 0xE) { // 8xyE - SHL Vx {, Vy}
+        unsigned char src = Q::shift_vy ? V[y] : V[x];
+        V[x] = src*2;
+        V[0xF] = src >> 7;
+
+    } else {
+        (void)x;
+        (void)y;
+        return raiseFault("unknown 8xy_ opcode");
+    }
+
+    pc += 2;
+    return 1;
+}
+
+
+// FxNN, timers, keyboard and memory
+template <class Q, unsigned N>
+unsigned int Chip8::opMisc() {
+    unsigned char x = (opcode & 0x0F00) >> 8;
+
+    if constexpr (N == 0x00 && Q::xochip) { // F000 nnnn - LD I, long addr
+        if (x != 0) {
+            return raiseFault("unknown Fx__ opcode");
+        }
+        I = ram[(pc + 2) & Q::ram_mask] << 8 | ram[(pc + 3) & Q::ram_mask];
+        pc += 2; // the address, the opcode is below
+
+    } else if constexpr (N == 0x01 && Q::xochip) { // Fn01 - PLANE n
+        planes = x & ALL_PLANES;
+
+    } else if constexpr (N == 0x02 && Q::xochip) { // F002 - AUDIO
+        if (x != 0) {
+            return raiseFault("unknown Fx__ opcode");
+        }
+        for (int i=0; i<16; i++) {
+            audio_pattern[i] = ram[(I + i) & Q::ram_mask];
+        }
+
+    } else if constexpr (N == 0x07) { // Fx07 - LD Vx, DT
+        V[x] = delay_timer;
+        pc += 2;
+        // Fx07 + 3x00 + 1nnn: the usual wait on the delay timer
+        if (fusable<Q>(0x30 | x, 0xFF)) {
+            return 1 + skipIf<Q>(V[x] == ram[(pc + 1) & Q::ram_mask]);
+        }
+        return 1;
+
+    } else if constexpr (N == 0x0A) { // Fx0A - LD Vx, K
+        for (int i=0; i<16; i++) {
+            if (keys[i]) {
+                V[x] = i;
+                pc += 2;
+                return 1;
             }
-            break;
-        
-        case 0xF000:
-            switch (opcode & 0x00FF) {
-                case 0x0007: // Fx07 - LD Vx, DT
-                    V[(opcode & 0x0F00)>>8] = delay_timer;
-                    pc += 2;
-                    break;
-                
-                case 0x0015: // Fx15 - LD DT, Vx
-                    delay_timer = V[(opcode & 0x0F00)>>8];
-                    pc += 2;
-                    break;
-
-                case 0x0018: // Fx18 - LD ST, Vx
-                    sound_timer = V[(opcode & 0x0F00) >> 8];
-                    pc += 2;
-                    break;
-                
-                case 0x001E: // Fx1E - ADD I, Vx
-                    I += V[(opcode & 0x0F00) >> 8];
-                    pc += 2;
-                    break;
-                
-                case 0x0029: // Fx29 - LD F, Vx
-                    I = V[(opcode & 0x0F00) >> 8]*5;
-                    pc += 2;
-                    break;
-                
-                case 0x0033: // Fx33 - LD B, Vx
-                {
-                    ram[I]     = V[(opcode & 0x0F00) >> 8] / 100;
-                    ram[I + 1] = (V[(opcode & 0x0F00) >> 8] / 10) % 10;
-                    ram[I + 2] = V[(opcode & 0x0F00) >> 8] % 10;
-                    pc += 2;
-                }
-                    break;
-
-                case 0x0055: // Fx55 - LD [I], Vx
-                {
-                    unsigned char x  = ((opcode & 0x0F00) >> 8);
-                    printf("x: %#06x\n", x);
-                    for (int i=0; i <= x; i++) {
-                        ram[I+i] = V[i];
-                    }
-                    pc += 2;
-                }
-                    break;
-                
-                case 0x0065: // Fx65 - LD Vx, [I]
-                {
-                    unsigned short x = (opcode & 0x0F00) >> 8;
-                    for (int i=0; i<=x; i++) {
-                        V[i] = ram[I+i];
-                    }
-                    // I += ((opcode & 0x0F00) >> 8) + 1;
-                    pc += 2;
-                }
-                    break;
-
-                case 0x000A: // LD Vx, K
-                {
-                    for (int i=0; i<16; i++) {
-                        if (keys[i]) {
-                            unsigned char x  = ((opcode & 0x0F00) >> 8);
-                            V[x] = i;
-                            pc += 2;
-                            break;
-                        }
-                    }
+        }
+        key_waits++;
+        return 1;
+
+    } else if constexpr (N == 0x15) { // Fx15 - LD DT, Vx
+        delay_timer = V[x];
+
+    } else if constexpr (N == 0x18) { // Fx18 - LD ST, Vx
+        sound_timer = V[x];
+
+    } else if constexpr (N == 0x1E) { // Fx1E - ADD I, Vx
+        I += V[x];
+
+    } else if constexpr (N == 0x29) { // Fx29 - LD F, Vx
+        I = V[x]*5;
+
+    } else if constexpr (N == 0x30 && Q::schip) { // Fx30 - LD HF, Vx
+        I = BIG_FONT_ADDRESS + (V[x] & 0x0F)*10;
+
+    } else if constexpr (N == 0x3A && Q::xochip) { // Fx3A - PITCH Vx
+        pitch = V[x];
+
+    } else if constexpr (N == 0x33) { // Fx33 - LD B, Vx
+        store(I & Q::ram_mask,       V[x] / 100);
+        store((I + 1) & Q::ram_mask, (V[x] / 10) % 10);
+        store((I + 2) & Q::ram_mask, V[x] % 10);
+
+    } else if constexpr (N == 0x55) { // Fx55 - LD [I], Vx
+        for (int i=0; i <= x; i++) {
+            store((I + i) & Q::ram_mask, V[i]);
+        }
+        if constexpr (Q::load_store_i) {
+            I += x + 1;
+        }
+
+    } else if constexpr (N == 0x65) { // Fx65 - LD Vx, [I]
+        for (int i=0; i<=x; i++) {
+            V[i] = ram[(I + i) & Q::ram_mask];
+        }
+        if constexpr (Q::load_store_i) {
+            I += x + 1;
+        }
+
+    } else if constexpr (N == 0x75 && Q::schip) { // Fx75 - LD R, Vx, 8 flags (16 on XO-CHIP)
+        for (int i=0; i <= (Q::xochip ? x : x & 7); i++) {
+            rpl[i] = V[i];
+        }
+
+    } else if constexpr (N == 0x85 && Q::schip) { // Fx85 - LD Vx, R
+        for (int i=0; i <= (Q::xochip ? x : x & 7); i++) {
+            V[i] = rpl[i];
+        }
+
+    } else {
+        (void)x;
+        return raiseFault("unknown Fx__ opcode");
+    }
+
+    pc += 2;
+    return 1;
+}
+
+
+// SUPER-CHIP screen opcodes, and XO-CHIP's 00Dn. Scrolls move whole display
+// words, by the pixels of the current resolution, on the selected planes
+// (always just the first outside XO-CHIP). Switching resolution clears the
+// screen, as most SUPER-CHIP interpreters since do.
+unsigned int Chip8::opSuper() {
+    const int rows = displayHeight();
+
+    if (opcode == 0x00FD) { // 00FD - EXIT
+        return raiseFault("the game exited (00FD)");
+    } else if (opcode == 0x00FE || opcode == 0x00FF) { // 00FE - LOW, 00FF - HIGH
+        hires = opcode == 0x00FF;
+        clearDisplay(ALL_PLANES);
+        pc += 2;
+        return 1;
+    }
+
+    for (int p=0; p<DISPLAY_PLANES; p++) {
+        if (!(planes & (1 << p))) {
+            continue;
+        }
+        unsigned long long (*plane)[DISPLAY_WIDTH/64] = display[p];
+        int n = opcode & 0x000F;
+        if ((opcode & 0xFFF0) == 0x00C0) { // 00Cn - SCD nibble
+            memmove(plane[n], plane[0], (rows - n)*sizeof(plane[0]));
+            memset(plane[0], 0, n*sizeof(plane[0]));
+        } else if ((opcode & 0xFFF0) == 0x00D0) { // 00Dn - SCU nibble
+            memmove(plane[0], plane[n], (rows - n)*sizeof(plane[0]));
+            memset(plane[rows - n], 0, n*sizeof(plane[0]));
+        } else if (opcode == 0x00FB) { // 00FB - SCR, right by 4 pixels
+            for (int i=0; i<rows; i++) {
+                if (hires) {
+                    plane[i][1] = plane[i][1] >> 4 | plane[i][0] << 60;
                 }
-                    break;
-                
-                default:
-                    printf("Invalid OP code\n");
-                    exit(1);
+                plane[i][0] >>= 4;
             }
-        
-            break;
-
-        default: 
-            printf("Bad instruction: %#06x\n", opcode & 0xF000);
-            exit(1);
+        } else { // 00FC - SCL, left by 4 pixels
+            for (int i=0; i<rows; i++) {
+                plane[i][0] = plane[i][0] << 4 | plane[i][1] >> 60;
+                plane[i][1] <<= 4;
+            }
+        }
     }
+    rehashDisplay();
+
+    display_updated = true;
+    pc += 2;
+    return 1;
 }
@@ -1,36 +1,202 @@
+#pragma once
+
+#include <stddef.h>
 #include <chrono>
-#include <thread>
-#include <fstream>
+#include <string.h>
+
+
+// Behaviour profiles for the opcodes CHIP-8 variants disagree on
+enum Chip8Quirks {
+    QUIRKS_CHIP8 = 0, // Cowgod's technical reference, this emulator's default
+    QUIRKS_COSMAC,    // the original COSMAC VIP interpreter
+    QUIRKS_SCHIP,     // SUPER-CHIP 1.1
+    QUIRKS_XOCHIP,    // XO-CHIP, as Octo runs it
+    QUIRKS_COUNT
+};
+
+
+// The quirks of each Chip8Quirks profile. They are compile time constants so
+// every profile gets its own specialised execute, with the checks folded away.
+template <bool ShiftVy, bool LoadStoreIncI, bool JumpVx, bool ClipSprites, bool VfReset, bool Schip, bool XoChip>
+struct Quirks {
+    static constexpr bool shift_vy       = ShiftVy;       // 8xy6/8xyE shift Vy into Vx, instead of Vx in place
+    static constexpr bool load_store_i   = LoadStoreIncI; // Fx55/Fx65 leave I pointing after the last register
+    static constexpr bool jump_vx        = JumpVx;        // Bxnn jumps to xnn + Vx, instead of Bnnn to nnn + V0
+    static constexpr bool clip_sprites   = ClipSprites;   // sprites are clipped at the screen edges, instead of wrapping
+    static constexpr bool vf_reset       = VfReset;       // 8xy1/8xy2/8xy3 reset VF to 0
+    static constexpr bool schip          = Schip;         // SUPER-CHIP opcodes: 128x64 mode, scrolling, 16x16 sprites, big font, RPL flags
+    static constexpr bool xochip         = XoChip;        // XO-CHIP opcodes: long I loads, bit planes, register ranges, audio patterns
+    static constexpr unsigned int ram_mask = XoChip ? 0xFFFF : 0x0FFF; // 64KB of memory on XO-CHIP, 4KB otherwise
+    static constexpr bool debug          = false;         // consult the debugger flags, see Debugging
+};
+
+typedef Quirks<false, false, false, false, false, false, false> QuirksChip8;
+typedef Quirks<true,  true,  false, true,  true,  false, false> QuirksCosmac;
+typedef Quirks<false, false, true,  true,  false, true,  false> QuirksSchip;
+typedef Quirks<true,  true,  false, false, false, true,  true>  QuirksXochip;
+
+// A profile with the debugger checks compiled in. Machines only run it while
+// some debugger flag is set, so the debugger costs nothing otherwise.
+template <class Q>
+struct Debugging : Q {
+    static constexpr bool debug = true;
+};
+
+
+// Debugger flags, one byte per memory address
+enum Chip8DebugFlags {
+    DEBUG_BREAK  = 1, // stop before running the instruction at this address
+    DEBUG_READ   = 2, // stop before an instruction reads this address
+    DEBUG_WRITE  = 4, // stop before an instruction writes this address
+    DEBUG_CURSOR = 8  // like DEBUG_BREAK, and cleared everywhere once hit (run to cursor)
+};
+
+// Where and why the debugger stopped the machine
+struct Chip8Break {
+    bool active;
+    unsigned short pc;
+    unsigned short address; // the watched address, for DEBUG_READ and DEBUG_WRITE
+    unsigned char reason;   // one of Chip8DebugFlags
+};
+
+
+// Why the machine stopped. Bad games never take the process down, they just
+// leave the instance faulted.
+struct Chip8Fault {
+    bool active;
+    unsigned short pc;     // address of the offending instruction
+    unsigned short opcode;
+    const char* reason;
+};
 
 
 typedef struct Chip8 {
+    // Memory and stack sizes are powers of two, so every access made on
+    // behalf of the game is masked into bounds instead of checked. Memory is
+    // 4KB, or 64KB on XO-CHIP (see memorySize): ram has room for the largest,
+    // so every instance takes over 64KB whatever the profile.
+    enum {
+        RAM_SIZE   = 65536,
+        CLASSIC_RAM_SIZE = 4096,
+        STACK_SIZE = 16,
+        STACK_MASK = STACK_SIZE - 1,
+        DISPLAY_WIDTH  = 128, // SUPER-CHIP high resolution, 64x32 otherwise
+        DISPLAY_HEIGHT = 64,
+        DISPLAY_PLANES = 2,   // XO-CHIP, only the first one otherwise
+        ALL_PLANES     = (1 << DISPLAY_PLANES) - 1,
+        PACKED_DISPLAY_SIZE = 32*64/8,
+        PACKED_HIRES_SIZE   = DISPLAY_HEIGHT*DISPLAY_WIDTH/8
+    };
+
     unsigned short opcode;
-    unsigned char ram[4096];
     unsigned char V[16]; // CPU registers, from V0 to VE, with VF being for special cases
     unsigned short pc;
     unsigned short I; // Memory address register
     unsigned int clock; // Hz
 
-    unsigned short stack[24];
+    unsigned short stack[STACK_SIZE];
     unsigned short stack_pointer;
 
     unsigned char sound_timer; // Both timers operate at 60Hz, and at 60 they return to 0
     unsigned char delay_timer;
 
+    unsigned int rng_state; // for Cxkk
+
     unsigned char keys[16];
-    unsigned char display[32][64];
+    // Bit planes of rows of one bit per pixel, leftmost pixel in the top bit
+    // of the first word. Low resolution uses the top left 64x32, in the first
+    // word of a row. A pixel's colour is its bit in plane 0, plus 2 for plane 1.
+    unsigned long long display[DISPLAY_PLANES][DISPLAY_HEIGHT][DISPLAY_WIDTH/64];
+    bool hires; // SUPER-CHIP 128x64 mode
     bool display_updated;
+    unsigned char planes; // XO-CHIP planes drawn, cleared and scrolled, a mask
+    unsigned char rpl[16]; // SUPER-CHIP user flags, saved and restored by Fx75/Fx85
+
+    unsigned char audio_pattern[16]; // XO-CHIP 1 bit samples, played while the sound timer runs
+    unsigned char pitch;             // XO-CHIP, the pattern plays at 4000*2^((pitch-64)/48) Hz
+
+    unsigned long long ram_hash;     // incremental parts of stateHash
+    unsigned long long display_hash;
+
+    bool superinstructions; // fuse common opcode sequences into a single dispatch
+    unsigned int step_cycles; // instructions retired by the last runStep
+    unsigned long long instructions; // retired since power on, for the debugger
+    unsigned int frames; // timer ticks since power on
+    unsigned long long draws;     // Dxyn run since power on, for Chip8Stats
+    unsigned long long key_waits; // Fx0A run with no key held, i.e. idling
+    unsigned int* write_frames; // optional, memorySize() entries: frames + 1 at each address's last store
+    int cycle_credit; // runFrame's instruction budget, in 1/60ths of an instruction
+
+    Chip8Quirks quirks;
+    unsigned int (Chip8::*execute_fn)(); // execute specialised for the current quirks
+    Chip8Fault fault;
+
+    unsigned char* debug_flags;    // optional, memorySize() entries: Chip8DebugFlags by address, owned by the debugger
+    unsigned int debug_flag_count; // addresses with any flag set
+    Chip8Break debug_break;
+    bool debug_resume; // run the next instruction even if it would stop
 
     std::chrono::time_point<std::chrono::high_resolution_clock> last_fetch; 
     std::chrono::time_point<std::chrono::high_resolution_clock> last_timer; 
 
-    unsigned short game_max_address; // tracks the maximum address used by the loaded game
-  
+    unsigned int game_max_address; // tracks the maximum address used by the loaded game
+
+    // Last, so copies can stop at the end of the profile's memory (see
+    // stateSize). Nothing past it is ever read.
+    unsigned char ram[RAM_SIZE];
 
     Chip8();
 
-    bool loadGame(const char* fileName);
+    bool loadGame(const char* fileName, Chip8Quirks profile = QUIRKS_CHIP8);
+    bool loadRom(const unsigned char* data, size_t length, Chip8Quirks profile = QUIRKS_CHIP8);
+    void setQuirks(Chip8Quirks profile);
+    void seed(unsigned int value);
     void runStep();
+    unsigned int execute();
+    unsigned int runFrame();
+    void tickTimers();
+    static unsigned int memorySize(Chip8Quirks profile) { return profile == QUIRKS_XOCHIP ? RAM_SIZE : CLASSIC_RAM_SIZE; }
+    unsigned int memorySize() const { return memorySize(quirks); }
+    unsigned int ramMask() const { return memorySize() - 1; }
+    size_t stateSize() const { return offsetof(Chip8, ram) + memorySize(); }
+    void restore(const Chip8& from);
+    int displayWidth() const { return hires ? 128 : 64; }
+    int displayHeight() const { return hires ? 64 : 32; }
+    unsigned int pixel(int x, int y) const {
+        return ((display[0][y][x >> 6] >> (63 - (x & 63))) & 1) | ((display[1][y][x >> 6] >> (63 - (x & 63))) & 1) << 1;
+    }
+    void setPixel(int x, int y, bool on, int plane = 0);
+    void poke(unsigned int address, unsigned char value);
+    void packDisplay(unsigned char* out, int plane = 0) const;
+    void packHires(unsigned char* out, int plane = 0) const;
+    float audioRate() const;
+    unsigned long long stateHash() const;
+    void rehash();
+    static unsigned long long hashBytes(unsigned long long h, const void* data, size_t size);
+    void clearFault();
+    void setDebugFlags(unsigned short address, unsigned char flags);
+    void clearDebugFlags(unsigned char flags);
+    void resume();
+    unsigned int step();
+    unsigned char debugHit(unsigned short& address) const;
+
+    template <class Q> unsigned int executeQuirks();
+    template <class Q, unsigned N> unsigned int op();     // by high nibble
+    template <class Q, unsigned N> unsigned int opAlu();  // 8xyN
+    template <class Q, unsigned N> unsigned int opMisc(); // FxNN
+    unsigned int opSuper(); // SUPER-CHIP and XO-CHIP screen opcodes, 00Cn, 00Dn and 00FB-00FF
+    unsigned int executeFaulted();
+    void selectExecute();
+    bool debugStop();
+    unsigned int raiseFault(const char* reason);
+    unsigned char random();
+    void store(unsigned short address, unsigned char value);
+    bool flipPixels(int plane, int row, int word, unsigned long long bits);
+    void clearDisplay(unsigned char mask);
+    void rehashDisplay();
+    template <class Q> bool fusable(unsigned char high, unsigned char high_mask);
+    template <class Q> unsigned int skipIf(bool condition);
+    template <class Q> void draw(unsigned char x, unsigned char y, unsigned char height);
 
 } Chip8;
 
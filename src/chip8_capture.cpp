@@ -0,0 +1,320 @@
+#include <algorithm>
+#include "chip8_capture.h"
+
+// GIF89a at 128x64 times the scale, low resolution pixels doubled, with a 4
+// colour global palette indexed by the pixel colours: black, white, and two
+// greys for XO-CHIP's second plane. After the first image, each one only
+// covers the rows and bytes of the screen that changed and is left in place
+// for the next.
+#define CLEAR_CODE 4 // LZW with a 2 bit minimum code size
+#define END_CODE   5
+#define MAX_CODE   4095
+
+
+static void put16(std::ofstream& out, unsigned int value) {
+    out.put(value & 0xFF);
+    out.put((value >> 8) & 0xFF);
+}
+
+
+Chip8Capture::Chip8Capture() {
+    scale = 2;
+    lossless = false;
+    frames = 0;
+    dropped = 0;
+    held = 0;
+}
+
+
+Chip8Capture::~Chip8Capture() {
+    stop();
+}
+
+
+// Starts capturing to fileName with the machine's screen as the first frame
+bool Chip8Capture::start(const char* fileName, const Chip8& machine, unsigned int value) {
+    stop();
+    out.open(fileName, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        return false;
+    }
+    scale = value;
+    frames = 0;
+    dropped = 0;
+    held = 0;
+    started = false;
+    any_written = false;
+    screen_end = 0;
+    written_time = 0;
+    memset(queued, 0, sizeof(queued));
+    memset(screen, 0, sizeof(screen));
+    memset(written, 0, sizeof(written));
+
+    static const unsigned char palette[12] = { 0, 0, 0, 255, 255, 255, 85, 85, 85, 170, 170, 170 };
+    out.write("GIF89a", 6);
+    put16(out, Chip8::DISPLAY_WIDTH*scale);
+    put16(out, Chip8::DISPLAY_HEIGHT*scale);
+    out.put((char)0x91); // global palette of 4 colours
+    out.put(0);
+    out.put(0);
+    out.write((const char*)palette, sizeof(palette));
+    out.write("\x21\xFF\x0BNETSCAPE2.0\x03\x01\x00\x00\x00", 19); // loop forever
+
+    unsigned char packed[CAPTURE_SCREEN_SIZE];
+    pack(machine, packed);
+    push(packed, false);
+    worker = std::thread(&Chip8Capture::work, this);
+    return true;
+}
+
+
+// Call after every runFrame. Only waits on the encoder when lossless.
+void Chip8Capture::frame(const Chip8& machine) {
+    if (!active()) {
+        return;
+    }
+    unsigned char packed[CAPTURE_SCREEN_SIZE];
+    pack(machine, packed);
+    frames++;
+    held++;
+    if (memcmp(packed, queued, sizeof(packed)) != 0) {
+        push(packed, false);
+    }
+}
+
+
+// Waits for the encoder to catch up and finishes the file
+void Chip8Capture::stop() {
+    if (!active()) {
+        return;
+    }
+    push(queued, true);
+    worker.join();
+    out.put(0x3B);
+    out.close();
+}
+
+
+bool Chip8Capture::active() const {
+    return worker.joinable();
+}
+
+
+void Chip8Capture::pack(const Chip8& machine, unsigned char* packed) {
+    for (int p=0; p<Chip8::DISPLAY_PLANES; p++) {
+        machine.packHires(&packed[p*Chip8::PACKED_HIRES_SIZE], p);
+    }
+}
+
+
+static void putCount(std::vector<unsigned char>& out, unsigned int count) {
+    out.push_back(count & 0xFF);
+    out.push_back(count >> 8);
+}
+
+
+// Runs of changed bytes, with gaps shorter than a run header kept inside
+// the run rather than starting a new one
+static void encodeDelta(std::vector<unsigned char>& out, const unsigned char* packed, const unsigned char* queued) {
+    int done = 0;
+    int i = 0;
+    for (;;) {
+        while (i < CAPTURE_SCREEN_SIZE && packed[i] == queued[i]) {
+            i++;
+        }
+        if (i == CAPTURE_SCREEN_SIZE) {
+            return;
+        }
+        int start = i, end = i;
+        for (; i < CAPTURE_SCREEN_SIZE && i - end < Chip8CaptureFrame::RUN_HEADER; i++) {
+            if (packed[i] != queued[i]) {
+                end = i + 1;
+            }
+        }
+        putCount(out, start - done);
+        putCount(out, end - start);
+        for (int j=start; j<end; j++) {
+            out.push_back(packed[j] ^ queued[j]);
+        }
+        done = i = end;
+    }
+}
+
+
+void Chip8Capture::push(const unsigned char* packed, bool last) {
+    Chip8CaptureFrame item;
+    encodeDelta(item.delta, packed, queued);
+    item.held = held;
+    item.last = last;
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        if (lossless) {
+            drained.wait(guard, [this] { return queue.size() < QUEUE_FRAMES; });
+        }
+        if (!last && queue.size() >= QUEUE_FRAMES) {
+            dropped++;
+            return;
+        }
+        queue.push_back(std::move(item));
+    }
+    ready.notify_one();
+    memcpy(queued, packed, sizeof(queued));
+    held = 0;
+}
+
+
+void Chip8Capture::work() {
+    std::unique_lock<std::mutex> guard(lock);
+    for (;;) {
+        ready.wait(guard, [this] { return !queue.empty(); });
+        Chip8CaptureFrame item = std::move(queue.front());
+        queue.pop_front();
+        guard.unlock();
+        drained.notify_one();
+        encode(item);
+        if (item.last) {
+            return;
+        }
+        guard.lock();
+    }
+}
+
+
+// Rebuilds the next screen and writes out the one before it, now that its
+// delay is known. Screens that would show for less than MIN_DELAY are
+// skipped, the time going to the one after them.
+void Chip8Capture::encode(const Chip8CaptureFrame& item) {
+    screen_end += item.held;
+    if (started) {
+        unsigned long long end = (screen_end * 100 + 30) / 60;
+        unsigned long long delay = end - written_time;
+        if (item.last) {
+            writeScreen(delay < MIN_DELAY ? MIN_DELAY : delay);
+            return;
+        }
+        if (delay >= MIN_DELAY) {
+            writeScreen(delay);
+        }
+    }
+    started = true;
+    const std::vector<unsigned char>& delta = item.delta;
+    size_t at = 0;
+    for (size_t i=0; i<delta.size(); ) {
+        at += delta[i] | delta[i + 1] << 8;
+        unsigned int count = delta[i + 2] | delta[i + 3] << 8;
+        i += Chip8CaptureFrame::RUN_HEADER;
+        for (unsigned int j=0; j<count; j++) {
+            screen[at++] ^= delta[i++];
+        }
+    }
+}
+
+
+void Chip8Capture::writeScreen(unsigned int delay) {
+    // the rows and bytes that changed since the last screen written, on
+    // either plane
+    const int stride = Chip8::DISPLAY_WIDTH/8;
+    int top = Chip8::DISPLAY_HEIGHT, bottom = -1, left = stride, right = -1;
+    for (int i=0; i<Chip8::DISPLAY_HEIGHT; i++) {
+        for (int j=0; j<stride; j++) {
+            int second = Chip8::PACKED_HIRES_SIZE + i*stride + j;
+            if (!any_written || screen[i*stride + j] != written[i*stride + j] || screen[second] != written[second]) {
+                top = std::min(top, i);
+                bottom = i;
+                left = std::min(left, j);
+                right = std::max(right, j);
+            }
+        }
+    }
+    if (bottom < 0) {
+        // same as written, e.g. a screen that didn't last: one unchanged byte
+        // carries the delay
+        top = bottom = left = right = 0;
+    }
+
+    out.write("\x21\xF9\x04\x04", 4); // graphic control, leave the image in place
+    put16(out, std::min(delay, 0xFFFFu));
+    out.put(0);
+    out.put(0);
+    writeImage(left*8, top, (right - left + 1)*8, bottom - top + 1);
+
+    memcpy(written, screen, sizeof(written));
+    any_written = true;
+    written_time += delay;
+}
+
+
+// One image of the screen's rectangle from (left, top), LZW compressed
+void Chip8Capture::writeImage(int left, int top, int width, int height) {
+    out.put(0x2C);
+    put16(out, left*scale);
+    put16(out, top*scale);
+    put16(out, width*scale);
+    put16(out, height*scale);
+    out.put(0);
+
+    codes.assign((MAX_CODE + 1)*4, 0);
+    block.clear();
+    unsigned int next = END_CODE;
+    unsigned int code_size = 3;
+    unsigned int bits = 0;
+    unsigned int bit_count = 0;
+    auto emit = [&](unsigned int code) {
+        bits |= code << bit_count;
+        bit_count += code_size;
+        while (bit_count >= 8) {
+            block.push_back(bits & 0xFF);
+            bits >>= 8;
+            bit_count -= 8;
+        }
+    };
+
+    emit(CLEAR_CODE);
+    int current = -1;
+    for (int y=0; y<height*(int)scale; y++) {
+        const unsigned char* row = &screen[(top + y/scale)*(Chip8::DISPLAY_WIDTH/8)];
+        const unsigned char* row2 = row + Chip8::PACKED_HIRES_SIZE;
+        for (int x=0; x<width*(int)scale; x++) {
+            int column = left + x/scale;
+            unsigned int pixel = ((row[column >> 3] >> (7 - (column & 7))) & 1) | ((row2[column >> 3] >> (7 - (column & 7))) & 1) << 1;
+            if (current < 0) {
+                current = pixel;
+                continue;
+            }
+            unsigned short child = codes[current*4 + pixel];
+            if (child) {
+                current = child;
+                continue;
+            }
+            emit(current);
+            codes[current*4 + pixel] = ++next;
+            if (next >= 1u << code_size) {
+                code_size++;
+            }
+            if (next == MAX_CODE) {
+                emit(CLEAR_CODE);
+                codes.assign(codes.size(), 0);
+                next = END_CODE;
+                code_size = 3;
+            }
+            current = pixel;
+        }
+    }
+    emit(current);
+    // the decoder adds a code on reading the last one, which can widen the end
+    if (++next >= 1u << code_size) {
+        code_size++;
+    }
+    emit(END_CODE);
+    if (bit_count > 0) {
+        block.push_back(bits & 0xFF);
+    }
+
+    out.put(2); // minimum code size
+    for (size_t i=0; i<block.size(); i+=255) {
+        size_t length = std::min(block.size() - i, (size_t)255);
+        out.put(length);
+        out.write((const char*)&block[i], length);
+    }
+    out.put(0);
+}
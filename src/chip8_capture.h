@@ -0,0 +1,82 @@
+#pragma once
+
+#include <deque>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include "chip8.h"
+
+
+// Both planes of a screen, bit-packed at 128x64 as by Chip8::packHires
+#define CAPTURE_SCREEN_SIZE (Chip8::DISPLAY_PLANES*Chip8::PACKED_HIRES_SIZE)
+
+// A new screen on its way to the encoder, XORed against the screen queued
+// before it and run-length encoded, so it only takes as much memory as the
+// screen changed by: runs of a 16 bit count of unchanged bytes to skip, a 16
+// bit count of bytes that follow, then those bytes of the XOR.
+struct Chip8CaptureFrame {
+    enum { RUN_HEADER = 4 };
+
+    std::vector<unsigned char> delta;
+    unsigned int held; // frames the previous screen stayed up for
+    bool last;         // end of the capture
+};
+
+
+// Records gameplay to an animated GIF. The emulation thread hands over each
+// frame's screen and a background thread encodes it, through a queue that
+// holds at most QUEUE_FRAMES screens. Frames that don't change the screen
+// only extend the previous one. When the queue is full the new screen is
+// dropped instead of waiting for the encoder, its time added to the
+// previous one, unless lossless is set (for headless tools running faster
+// than real time).
+typedef struct Chip8Capture {
+    enum {
+        QUEUE_FRAMES = 600, // 10 seconds of screens that all change
+        MIN_DELAY    = 2    // hundredths of a second, players slow shorter frames down
+    };
+
+    unsigned int scale; // output pixels per 128x64 pixel
+    bool lossless;      // wait for the encoder rather than drop screens
+    unsigned int frames;  // seen since start
+    unsigned int dropped; // screens lost to a full queue
+
+    // emulation thread
+    unsigned char queued[CAPTURE_SCREEN_SIZE]; // last screen queued
+    unsigned int held;
+
+    std::deque<Chip8CaptureFrame> queue;
+    std::mutex lock;
+    std::condition_variable ready;
+    std::condition_variable drained;
+    std::thread worker;
+
+    // encoder thread
+    std::ofstream out;
+    unsigned char screen[CAPTURE_SCREEN_SIZE];  // waiting for its delay to be known
+    unsigned char written[CAPTURE_SCREEN_SIZE]; // last screen in the file
+    bool started;          // screen holds the first screen
+    bool any_written;
+    unsigned long long screen_end;   // frames up to the end of screen
+    unsigned long long written_time; // hundredths of a second in the file
+    std::vector<unsigned short> codes; // LZW dictionary, 4 children per code
+    std::vector<unsigned char> block;
+
+    Chip8Capture();
+    ~Chip8Capture();
+
+    bool start(const char* fileName, const Chip8& machine, unsigned int scale = 2);
+    void frame(const Chip8& machine);
+    void stop();
+    bool active() const;
+
+    static void pack(const Chip8& machine, unsigned char* packed);
+    void push(const unsigned char* packed, bool last);
+    void work();
+    void encode(const Chip8CaptureFrame& item);
+    void writeScreen(unsigned int delay);
+    void writeImage(int left, int top, int width, int height);
+
+} Chip8Capture;
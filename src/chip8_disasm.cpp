@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include "chip8_disasm.h"
+
+
+Chip8Disassembly::Chip8Disassembly() {
+    memset(decoded, 0, sizeof(decoded));
+}
+
+
+// The line for the instruction at address, decoding it only if it's new or
+// its bytes changed since
+const char* Chip8Disassembly::line(const Chip8& machine, unsigned short address) {
+    const unsigned int mask = machine.ramMask();
+    address &= mask;
+    unsigned short opcode = machine.ram[address] << 8 | machine.ram[(address + 1) & mask];
+    unsigned short next = 0;
+    if (opcode == 0xF000) {
+        next = machine.ram[(address + 2) & mask] << 8 | machine.ram[(address + 3) & mask];
+    }
+    unsigned int key = (unsigned int)next << 16 | opcode;
+    if (!decoded[address] || opcodes[address] != key) {
+        decode(opcode, text[address], LINE_SIZE, next);
+        opcodes[address] = key;
+        decoded[address] = true;
+    }
+    return text[address];
+}
+
+
+// Mnemonics from Cowgod's Chip-8 technical reference, SUPER-CHIP's included,
+// and Octo's names for XO-CHIP's. next is the word after the opcode, only
+// used by F000 nnnn. Anything that isn't an instruction shows as data.
+void Chip8Disassembly::decode(unsigned short opcode, char* out, size_t size, unsigned short next) {
+    unsigned int x   = (opcode >> 8) & 0xF;
+    unsigned int y   = (opcode >> 4) & 0xF;
+    unsigned int n   = opcode & 0xF;
+    unsigned int kk  = opcode & 0xFF;
+    unsigned int nnn = opcode & 0xFFF;
+    static const char* alu[16] = {
+        "LD", "OR", "AND", "XOR", "ADD", "SUB", "SHR", "SUBN",
+        NULL, NULL, NULL, NULL, NULL, NULL, "SHL", NULL
+    };
+
+    switch (opcode >> 12) {
+    case 0x0:
+        if (opcode == 0x00E0) {
+            snprintf(out, size, "CLS");
+        } else if (opcode == 0x00EE) {
+            snprintf(out, size, "RET");
+        } else if ((opcode & 0xFFF0) == 0x00C0) {
+            snprintf(out, size, "SCD %X", n);
+        } else if ((opcode & 0xFFF0) == 0x00D0) {
+            snprintf(out, size, "SCU %X", n);
+        } else if (opcode >= 0x00FB && opcode <= 0x00FF) {
+            static const char* screen[5] = { "SCR", "SCL", "EXIT", "LOW", "HIGH" };
+            snprintf(out, size, "%s", screen[opcode - 0x00FB]);
+        } else {
+            snprintf(out, size, "SYS %03X", nnn);
+        }
+        return;
+    case 0x1: snprintf(out, size, "JP %03X", nnn); return;
+    case 0x2: snprintf(out, size, "CALL %03X", nnn); return;
+    case 0x3: snprintf(out, size, "SE V%X, %02X", x, kk); return;
+    case 0x4: snprintf(out, size, "SNE V%X, %02X", x, kk); return;
+    case 0x5:
+        if (n == 0) {
+            snprintf(out, size, "SE V%X, V%X", x, y);
+            return;
+        } else if (n == 2) {
+            snprintf(out, size, "LD [I], V%X-V%X", x, y);
+            return;
+        } else if (n == 3) {
+            snprintf(out, size, "LD V%X-V%X, [I]", x, y);
+            return;
+        }
+        break;
+    case 0x6: snprintf(out, size, "LD V%X, %02X", x, kk); return;
+    case 0x7: snprintf(out, size, "ADD V%X, %02X", x, kk); return;
+    case 0x8:
+        if (alu[n]) {
+            if (n == 0x6 || n == 0xE) {
+                snprintf(out, size, "%s V%X {, V%X}", alu[n], x, y);
+            } else {
+                snprintf(out, size, "%s V%X, V%X", alu[n], x, y);
+            }
+            return;
+        }
+        break;
+    case 0x9:
+        if (n == 0) {
+            snprintf(out, size, "SNE V%X, V%X", x, y);
+            return;
+        }
+        break;
+    case 0xA: snprintf(out, size, "LD I, %03X", nnn); return;
+    case 0xB: snprintf(out, size, "JP V0, %03X", nnn); return;
+    case 0xC: snprintf(out, size, "RND V%X, %02X", x, kk); return;
+    case 0xD: snprintf(out, size, "DRW V%X, V%X, %X", x, y, n); return;
+    case 0xE:
+        if (kk == 0x9E) {
+            snprintf(out, size, "SKP V%X", x);
+            return;
+        } else if (kk == 0xA1) {
+            snprintf(out, size, "SKNP V%X", x);
+            return;
+        }
+        break;
+    case 0xF:
+        if (opcode == 0xF000) {
+            snprintf(out, size, "LD I, %04X", next);
+            return;
+        } else if (opcode == 0xF002) {
+            snprintf(out, size, "AUDIO");
+            return;
+        }
+        switch (kk) {
+        case 0x01: snprintf(out, size, "PLANE %X", x); return;
+        case 0x07: snprintf(out, size, "LD V%X, DT", x); return;
+        case 0x0A: snprintf(out, size, "LD V%X, K", x); return;
+        case 0x15: snprintf(out, size, "LD DT, V%X", x); return;
+        case 0x18: snprintf(out, size, "LD ST, V%X", x); return;
+        case 0x1E: snprintf(out, size, "ADD I, V%X", x); return;
+        case 0x29: snprintf(out, size, "LD F, V%X", x); return;
+        case 0x30: snprintf(out, size, "LD HF, V%X", x); return;
+        case 0x33: snprintf(out, size, "LD B, V%X", x); return;
+        case 0x3A: snprintf(out, size, "PITCH V%X", x); return;
+        case 0x55: snprintf(out, size, "LD [I], V%X", x); return;
+        case 0x65: snprintf(out, size, "LD V%X, [I]", x); return;
+        case 0x75: snprintf(out, size, "LD R, V%X", x); return;
+        case 0x85: snprintf(out, size, "LD V%X, R", x); return;
+        }
+        break;
+    }
+    snprintf(out, size, "DW %04X", opcode);
+}
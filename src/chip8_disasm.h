@@ -0,0 +1,22 @@
+#pragma once
+
+#include "chip8.h"
+
+
+// Disassembly of a machine's memory for the debugger, one line per address.
+// Lines are decoded once and kept along with the opcode they were decoded
+// from, so they are only redone after a write changes those two bytes (or
+// the address after F000).
+typedef struct Chip8Disassembly {
+    enum { LINE_SIZE = 20 };
+
+    char text[Chip8::RAM_SIZE][LINE_SIZE];
+    unsigned int opcodes[Chip8::RAM_SIZE]; // what each line was decoded from, with the address for F000
+    bool decoded[Chip8::RAM_SIZE];
+
+    Chip8Disassembly();
+
+    const char* line(const Chip8& machine, unsigned short address);
+    static void decode(unsigned short opcode, char* out, size_t size, unsigned short next = 0);
+
+} Chip8Disassembly;
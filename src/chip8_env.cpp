@@ -0,0 +1,148 @@
+#include "chip8_env.h"
+
+
+Chip8Env::Chip8Env(int instances, int threads) : pool(threads) {
+    machines.resize(instances);
+    scores.assign(instances, 0.0f);
+    score_fn = NULL;
+    done_fn  = NULL;
+    user     = NULL;
+    stats    = NULL;
+
+    downsample  = 1;
+    flicker_max = false;
+}
+
+
+bool Chip8Env::loadGame(const char* fileName, Chip8Quirks profile) {
+    initial = Chip8();
+    return initial.loadGame(fileName, profile);
+}
+
+
+bool Chip8Env::loadRom(const unsigned char* data, size_t length, Chip8Quirks profile) {
+    initial = Chip8();
+    return initial.loadRom(data, length, profile);
+}
+
+
+// Only factors that divide both sides of the 64x32 screen are taken, so
+// every block is whole and rows don't spill into each other. Returns false,
+// leaving the format as it was, for any other.
+bool Chip8Env::setDownsample(int factor) {
+    if (factor < 1 || 32 % factor != 0) {
+        return false;
+    }
+    downsample = factor;
+    return true;
+}
+
+
+// Bytes per observation with the current format. Observations are 64/downsample
+// by 32/downsample bits, rows first, leftmost pixel in the most significant bit.
+// Rounded up to whole bytes: at 32x32 blocks that's 2 bits.
+int Chip8Env::observationSize() const {
+    return (64 / downsample * (32 / downsample) + 7) / 8;
+}
+
+
+// Restarts every instance, instance i seeded with seed + i, and writes the
+// first observations.
+void Chip8Env::reset(unsigned int seed, unsigned char* observations) {
+    for (size_t i=0; i<machines.size(); i++) {
+        resetInstance(i, seed + i, observations + i*observationSize());
+    }
+}
+
+
+void Chip8Env::resetInstance(int instance, unsigned int seed, unsigned char* observation) {
+    Chip8& machine = machines[instance];
+    machine.restore(initial);
+    machine.seed(seed);
+    if (stats) {
+        stats->restart(instance);
+    }
+    scores[instance] = score_fn ? score_fn(machine, user) : 0.0f;
+    observe(machine, observation);
+}
+
+
+// Holds the keys in actions (bit k for key k) on each instance for the given
+// number of 60Hz frames, then writes its observation, reward and done flag.
+// Frames in between are skipped: the screen is only read at the end of the
+// step (and right before the last frame, with flicker_max).
+void Chip8Env::step(const unsigned short* actions, int frames, unsigned char* observations, float* rewards, unsigned char* dones) {
+    step_actions      = actions;
+    step_frames       = frames;
+    step_observations = observations;
+    step_rewards      = rewards;
+    step_dones        = dones;
+
+    pool.run(&Chip8Env::stepRange, this, (int)machines.size());
+}
+
+
+void Chip8Env::stepRange(void* env, int begin, int end) {
+    Chip8Env* self = (Chip8Env*)env;
+    for (int i=begin; i<end; i++) {
+        self->stepInstance(i);
+    }
+}
+
+
+void Chip8Env::stepInstance(int instance) {
+    Chip8& machine = machines[instance];
+
+    unsigned short action = step_actions[instance];
+    for (int k=0; k<16; k++) {
+        machine.keys[k] = (action >> k) & 1;
+    }
+    unsigned char* observation = step_observations + instance*observationSize();
+    unsigned char previous[OBSERVATION_SIZE];
+    auto begin = std::chrono::steady_clock::now();
+    for (int f=0; f<step_frames; f++) {
+        if (flicker_max && f == step_frames - 1) {
+            observe(machine, previous);
+        }
+        machine.runFrame();
+    }
+    if (stats && step_frames > 0) {
+        std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - begin;
+        stats->record(instance, machine, (unsigned int)(elapsed.count() / step_frames), step_frames);
+    }
+
+    float score = score_fn ? score_fn(machine, user) : 0.0f;
+    step_rewards[instance] = score - scores[instance];
+    scores[instance] = score;
+    step_dones[instance] = machine.fault.active || (done_fn && done_fn(machine, user));
+    observe(machine, observation);
+    if (flicker_max && step_frames > 0) {
+        for (int i=0; i<observationSize(); i++) {
+            observation[i] |= previous[i];
+        }
+    }
+}
+
+
+// Writes the screen in the current observation format, from the machine's
+// display at 64x32.
+void Chip8Env::observe(const Chip8& machine, unsigned char* out) const {
+    if (downsample <= 1) {
+        machine.packDisplay(out);
+        return;
+    }
+
+    unsigned char packed[Chip8::PACKED_DISPLAY_SIZE];
+    machine.packDisplay(packed);
+    int size = observationSize();
+    int width = 64 / downsample;
+    memset(out, 0, size);
+    for (int i=0; i<32; i++) {
+        for (int j=0; j<64; j++) {
+            if (packed[i*8 + j/8] & (0x80 >> (j & 7))) {
+                int bit = (i / downsample) * width + j / downsample;
+                out[bit >> 3] |= 0x80 >> (bit & 7);
+            }
+        }
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vector>
+#include "chip8.h"
+#include "chip8_stats.h"
+#include "thread_pool.h"
+
+
+// Game specific hooks, called from the stepping threads. The score is read
+// after every step and the reward is how much it changed, done ends an episode
+// early (faults always do).
+typedef float (*Chip8ScoreFn)(const Chip8& machine, void* user);
+typedef bool (*Chip8DoneFn)(const Chip8& machine, void* user);
+
+
+// Gym style environment over a batch of machines running the same game, for
+// training agents without the GUI. Observations, rewards and done flags go to
+// caller provided buffers laid out instance after instance, so stepping
+// doesn't allocate. Instances are stepped in parallel on a thread pool.
+typedef struct Chip8Env {
+    // bytes per full size observation, see Chip8::packDisplay
+    enum { OBSERVATION_SIZE = Chip8::PACKED_DISPLAY_SIZE };
+
+    std::vector<Chip8> machines;
+    std::vector<float> scores;
+    Chip8 initial; // the loaded game, copied over a machine on reset
+
+    // Observation format, both off by default. downsample max pools square
+    // blocks of 2x2, 4x4 (and so on up to 32x32) pixels into one bit, set it
+    // with setDownsample. flicker_max ORs the last two frames of a step so
+    // sprites that games erase and redraw every other frame don't vanish
+    // from it.
+    int downsample;
+    bool flicker_max;
+
+    Chip8ScoreFn score_fn;
+    Chip8DoneFn done_fn;
+    void* user; // passed to the hooks
+
+    Chip8Stats* stats; // optional, opened with an instance each, published after every step
+
+    ThreadPool pool;
+
+    Chip8Env(int instances, int threads = 0);
+
+    bool loadGame(const char* fileName, Chip8Quirks profile = QUIRKS_CHIP8);
+    bool loadRom(const unsigned char* data, size_t length, Chip8Quirks profile = QUIRKS_CHIP8);
+
+    bool setDownsample(int factor);
+    int observationSize() const;
+    void reset(unsigned int seed, unsigned char* observations);
+    void resetInstance(int instance, unsigned int seed, unsigned char* observation);
+    void step(const unsigned short* actions, int frames, unsigned char* observations, float* rewards, unsigned char* dones);
+
+    // the step being run, for the workers
+    const unsigned short* step_actions;
+    int step_frames;
+    unsigned char* step_observations;
+    float* step_rewards;
+    unsigned char* step_dones;
+
+    static void stepRange(void* env, int begin, int end);
+    void stepInstance(int instance);
+    void observe(const Chip8& machine, unsigned char* out) const;
+
+} Chip8Env;
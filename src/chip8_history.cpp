@@ -0,0 +1,184 @@
+#include "chip8_history.h"
+#include "chip8_movie.h"
+
+
+Chip8Snapshot::Chip8Snapshot(const Chip8& machine, unsigned long long segment) {
+    const unsigned char* bytes = (const unsigned char*)&machine;
+    state.assign(bytes, bytes + machine.stateSize());
+    instructions = machine.instructions;
+    this->segment = segment;
+}
+
+
+void Chip8Snapshot::restore(Chip8& machine) const {
+    memcpy((void*)&machine, state.data(), state.size());
+}
+
+
+// Starts over from the machine as it is now
+void Chip8History::reset(const Chip8& machine) {
+    snapshots.clear();
+    snapshots.push_back(Chip8Snapshot(machine, 0));
+    snapshot_bytes = machine.stateSize();
+    segments.clear();
+    first_segment = 0;
+}
+
+
+// Call after every runFrame
+void Chip8History::frameDone(const Chip8& machine) {
+    record(machine, !machine.debug_break.active); // stopped frames don't tick
+}
+
+
+// Call after every Chip8::step
+void Chip8History::stepped(const Chip8& machine) {
+    record(machine, false);
+}
+
+
+void Chip8History::record(const Chip8& machine, bool tick) {
+    unsigned short keys = Chip8Movie::keyMask(machine);
+    if (!tick && !segments.empty() && segments.back().ticks == 0 && segments.back().keys == keys) {
+        // single steps with the same keys make one segment
+        segments.back().end = machine.instructions;
+        segments.back().cycle_credit = machine.cycle_credit;
+    } else if (tick && !segments.empty() && segments.back().ticks > 0 && segments.back().end == machine.instructions && segments.back().keys == keys) {
+        // a frame that ran nothing, so a faulted machine doesn't grow the log
+        segments.back().cycle_credit = machine.cycle_credit;
+        segments.back().ticks++;
+    } else {
+        Chip8Segment segment = { machine.instructions, keys, machine.cycle_credit, tick ? 1u : 0u };
+        segments.push_back(segment);
+    }
+
+    if (machine.instructions - snapshots.back().instructions >= SNAPSHOT_INTERVAL) {
+        snapshots.push_back(Chip8Snapshot(machine, first_segment + segments.size()));
+        snapshot_bytes += machine.stateSize();
+        while (snapshot_bytes > MAX_BYTES) {
+            snapshot_bytes -= snapshots.front().state.size();
+            snapshots.pop_front();
+            while (first_segment < snapshots.front().segment) {
+                segments.pop_front();
+                first_segment++;
+            }
+        }
+    }
+}
+
+
+// The earliest instruction count still reachable
+unsigned long long Chip8History::oldest() const {
+    return snapshots.front().instructions;
+}
+
+
+// Restores a snapshot and re-executes the recorded segments one instruction
+// at a time, up to the last state with target instructions retired. Hits on
+// the debugger flags before instructions are counted into last_hit, if
+// given. The machine's own debugger flags are kept. Returns the number of
+// the first segment that didn't run to its end.
+unsigned long long Chip8History::replay(Chip8& machine, size_t snapshot, unsigned long long target, unsigned long long* last_hit) {
+    unsigned char* flags = machine.debug_flags;
+    unsigned int flag_count = machine.debug_flag_count;
+
+    snapshots[snapshot].restore(machine);
+    machine.debug_flags = flags;
+    machine.debug_flag_count = flag_count;
+    machine.debug_break.active = false;
+    machine.debug_resume = false;
+    machine.selectExecute();
+
+    unsigned long long segment = snapshots[snapshot].segment;
+    for (; segment - first_segment < segments.size(); segment++) {
+        const Chip8Segment& s = segments[segment - first_segment];
+        if (s.end > target && machine.instructions >= target) {
+            break;
+        }
+        Chip8Movie::setKeys(machine, s.keys);
+        while (machine.instructions < s.end && machine.instructions < target) {
+            unsigned short address;
+            unsigned char hit = machine.debugHit(address);
+            if (last_hit && hit != 0 && hit != DEBUG_CURSOR) {
+                *last_hit = machine.instructions;
+            }
+            if (machine.step() == 0) {
+                break; // faulted, as it did when recorded
+            }
+        }
+        if (machine.instructions < s.end) {
+            break;
+        }
+        machine.cycle_credit = s.cycle_credit;
+        for (unsigned int tick=0; tick<s.ticks; tick++) {
+            machine.tickTimers();
+        }
+    }
+    return segment;
+}
+
+
+// Drops everything recorded after the machine's state, so execution carries
+// on from there as the new present
+void Chip8History::truncate(const Chip8& machine, unsigned long long segment) {
+    while (snapshots.size() > 1 && snapshots.back().segment > segment) {
+        snapshot_bytes -= snapshots.back().state.size();
+        snapshots.pop_back();
+    }
+    if (segment - first_segment < segments.size()) {
+        Chip8Segment partial = segments[segment - first_segment];
+        segments.resize(segment - first_segment);
+        if (segments.empty() ? machine.instructions > oldest() : machine.instructions > segments.back().end) {
+            partial.end = machine.instructions;
+            partial.cycle_credit = machine.cycle_credit;
+            partial.ticks = 0;
+            segments.push_back(partial);
+        }
+    }
+}
+
+
+// Takes the machine back to the last state with target instructions retired.
+// Fails if that's in the future or older than the history goes.
+bool Chip8History::seek(Chip8& machine, unsigned long long target) {
+    if (target > machine.instructions || target < oldest()) {
+        return false;
+    }
+    size_t snapshot = snapshots.size() - 1;
+    while (snapshots[snapshot].instructions > target) {
+        snapshot--;
+    }
+    truncate(machine, replay(machine, snapshot, target, NULL));
+    return true;
+}
+
+
+// Undoes the last instruction
+bool Chip8History::stepBack(Chip8& machine) {
+    return machine.instructions > 0 && seek(machine, machine.instructions - 1);
+}
+
+
+// Runs backwards to the last breakpoint or watchpoint hit before the
+// current instruction, searching one snapshot interval at a time from the
+// most recent. Stops at the oldest state and returns false if there's none.
+bool Chip8History::continueBack(Chip8& machine) {
+    const unsigned long long current = machine.instructions;
+    const unsigned long long none = ~0ULL;
+
+    for (size_t snapshot = snapshots.size(); snapshot-- > 0; ) {
+        if (snapshots[snapshot].instructions >= current) {
+            continue;
+        }
+        unsigned long long end = snapshot + 1 < snapshots.size() ? snapshots[snapshot + 1].instructions : current;
+        unsigned long long hit = none;
+        replay(machine, snapshot, end < current ? end : current, &hit);
+        if (hit != none) {
+            seek(machine, hit);
+            machine.debugStop();
+            return true;
+        }
+    }
+    seek(machine, oldest());
+    return false;
+}
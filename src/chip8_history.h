@@ -0,0 +1,63 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+#include "chip8.h"
+
+
+// A stretch of execution between two points the history can replay to
+// exactly: every instruction up to `end` ran with the same keys held, then
+// the frame ended (credit updated and timers ticked) or the debugger
+// stepped. Frames after it that ran nothing, as while faulted, only add
+// ticks.
+struct Chip8Segment {
+    unsigned long long end; // Chip8::instructions at the end of the segment
+    unsigned short keys;
+    int cycle_credit;       // after the segment
+    unsigned int ticks;     // frames that ended here, each ticking the timers
+};
+
+
+// The machine as far as the end of its profile's memory (Chip8::stateSize),
+// so 4KB games don't keep 64KB per snapshot
+struct Chip8Snapshot {
+    std::vector<unsigned char> state;
+    unsigned long long instructions; // the machine's, when taken
+    unsigned long long segment;      // segments run before it, counted from the reset
+
+    Chip8Snapshot(const Chip8& machine, unsigned long long segment);
+    void restore(Chip8& machine) const;
+};
+
+
+// Execution history for reverse debugging. It keeps a copy of the machine
+// every SNAPSHOT_INTERVAL instructions and a log of the segments run since,
+// so any past instruction can be reached by restoring the snapshot before
+// it and re-executing forward, one instruction at a time. Memory stays
+// bounded, the oldest snapshots are dropped past MAX_BYTES of them: about 12
+// million instructions back for 4KB games, 1.2 million for XO-CHIP's 64KB.
+typedef struct Chip8History {
+    enum {
+        SNAPSHOT_INTERVAL = 10000,  // instructions
+        MAX_BYTES         = 8 << 20 // of snapshots
+    };
+
+    std::deque<Chip8Snapshot> snapshots; // at segment boundaries, oldest first
+    size_t snapshot_bytes;
+    std::deque<Chip8Segment> segments;   // from the oldest snapshot on
+    unsigned long long first_segment;    // number of segments.front(), counted from the reset
+
+    void reset(const Chip8& machine);
+    void frameDone(const Chip8& machine);
+    void stepped(const Chip8& machine);
+
+    unsigned long long oldest() const;
+    bool seek(Chip8& machine, unsigned long long target);
+    bool stepBack(Chip8& machine);
+    bool continueBack(Chip8& machine);
+
+    void record(const Chip8& machine, bool tick);
+    unsigned long long replay(Chip8& machine, size_t snapshot, unsigned long long target, unsigned long long* last_hit);
+    void truncate(const Chip8& machine, unsigned long long segment);
+
+} Chip8History;
@@ -0,0 +1,239 @@
+#include <fstream>
+#include "chip8_movie.h"
+
+// File layout, little endian:
+//   "C8MV", version (1 byte), quirks (1 byte), 2 reserved bytes
+//   clock (4), seed (4), rom hash (8), run count (4), checkpoint count (4)
+//   runs:        keys (2), frames (4)
+//   checkpoints: frame (4), display hash (8)
+#define MOVIE_VERSION 1
+
+
+static void put(std::vector<unsigned char>& out, unsigned long long value, int bytes) {
+    for (int i=0; i<bytes; i++) {
+        out.push_back((value >> (8*i)) & 0xFF);
+    }
+}
+
+static unsigned long long get(const unsigned char*& in, int bytes) {
+    unsigned long long value = 0;
+    for (int i=0; i<bytes; i++) {
+        value |= (unsigned long long)in[i] << (8*i);
+    }
+    in += bytes;
+    return value;
+}
+
+
+Chip8Movie::Chip8Movie() {
+    quirks = QUIRKS_CHIP8;
+    clock = 500;
+    seed = 42;
+    rom_hash = 0;
+    frames = 0;
+    frame = 0;
+    run_index = 0;
+    run_offset = 0;
+    checkpoint_index = 0;
+    desync_frame = -1;
+}
+
+
+bool Chip8Movie::load(const char* fileName) {
+    std::ifstream fin(fileName, std::ios::binary|std::ios::ate);
+    std::ifstream::pos_type pos = fin.tellg();
+    int length = pos;
+    fin.seekg(0, std::ios::beg);
+    if (length < 32) {
+        return false;
+    }
+    std::vector<unsigned char> buffer(length);
+    fin.read((char*)buffer.data(), length);
+
+    const unsigned char* in = buffer.data();
+    if (memcmp(in, "C8MV", 4) != 0 || in[4] != MOVIE_VERSION || in[5] >= QUIRKS_COUNT) {
+        return false;
+    }
+    quirks = (Chip8Quirks)in[5];
+    in += 8;
+    clock = get(in, 4);
+    seed = get(in, 4);
+    rom_hash = get(in, 8);
+    unsigned long long run_count = get(in, 4);
+    unsigned long long checkpoint_count = get(in, 4);
+    if (32 + run_count*6 + checkpoint_count*12 != (unsigned long long)length) {
+        return false;
+    }
+
+    runs.resize(run_count);
+    frames = 0;
+    for (size_t i=0; i<runs.size(); i++) {
+        runs[i].keys = get(in, 2);
+        runs[i].frames = get(in, 4);
+        if (runs[i].frames == 0) {
+            return false;
+        }
+        frames += runs[i].frames;
+    }
+    checkpoints.resize(checkpoint_count);
+    for (size_t i=0; i<checkpoints.size(); i++) {
+        checkpoints[i].frame = get(in, 4);
+        checkpoints[i].display_hash = get(in, 8);
+    }
+    return true;
+}
+
+
+bool Chip8Movie::save(const char* fileName) const {
+    std::vector<unsigned char> out;
+    out.insert(out.end(), "C8MV", "C8MV" + 4);
+    put(out, MOVIE_VERSION, 1);
+    put(out, quirks, 1);
+    put(out, 0, 2);
+    put(out, clock, 4);
+    put(out, seed, 4);
+    put(out, rom_hash, 8);
+    put(out, runs.size(), 4);
+    put(out, checkpoints.size(), 4);
+    for (size_t i=0; i<runs.size(); i++) {
+        put(out, runs[i].keys, 2);
+        put(out, runs[i].frames, 4);
+    }
+    for (size_t i=0; i<checkpoints.size(); i++) {
+        put(out, checkpoints[i].frame, 4);
+        put(out, checkpoints[i].display_hash, 8);
+    }
+
+    std::ofstream fout(fileName, std::ios::binary);
+    fout.write((const char*)out.data(), out.size());
+    return fout.good();
+}
+
+
+// Starts a new recording from a freshly loaded game
+void Chip8Movie::startRecording(Chip8& machine, unsigned int value) {
+    quirks = machine.quirks;
+    clock = machine.clock;
+    seed = value;
+    rom_hash = romHash(machine);
+    runs.clear();
+    checkpoints.clear();
+    frames = 0;
+
+    machine.seed(seed);
+}
+
+
+// Runs one frame with the keys currently held, and records them
+void Chip8Movie::recordFrame(Chip8& machine) {
+    unsigned short mask = keyMask(machine);
+    if (runs.empty() || runs.back().keys != mask) {
+        Chip8MovieRun run = { mask, 0 };
+        runs.push_back(run);
+    }
+    runs.back().frames++;
+
+    machine.runFrame();
+    frames++;
+
+    if (frames % CHECKPOINT_INTERVAL == 0) {
+        Chip8Checkpoint checkpoint = { frames, displayHash(machine) };
+        checkpoints.push_back(checkpoint);
+    }
+}
+
+
+// Sets a freshly loaded game up to replay the movie from the start. Fails if
+// it isn't the game the movie was recorded on.
+bool Chip8Movie::startPlayback(Chip8& machine) {
+    if (romHash(machine) != rom_hash) {
+        return false;
+    }
+    machine.setQuirks(quirks);
+    machine.clock = clock;
+    machine.seed(seed);
+
+    frame = 0;
+    run_index = 0;
+    run_offset = 0;
+    checkpoint_index = 0;
+    desync_frame = -1;
+    return true;
+}
+
+
+// Runs the next frame with the recorded keys, false once the movie is over
+bool Chip8Movie::playFrame(Chip8& machine) {
+    if (finished()) {
+        return false;
+    }
+    setKeys(machine, runs[run_index].keys);
+    if (++run_offset == runs[run_index].frames) {
+        run_index++;
+        run_offset = 0;
+    }
+
+    machine.runFrame();
+    frame++;
+
+    if (checkpoint_index < checkpoints.size() && checkpoints[checkpoint_index].frame == frame) {
+        if (desync_frame < 0 && checkpoints[checkpoint_index].display_hash != displayHash(machine)) {
+            desync_frame = frame;
+        }
+        checkpoint_index++;
+    }
+    return true;
+}
+
+
+bool Chip8Movie::finished() const {
+    return run_index >= runs.size();
+}
+
+
+unsigned short Chip8Movie::keyMask(const Chip8& machine) {
+    unsigned short mask = 0;
+    for (int k=0; k<16; k++) {
+        if (machine.keys[k]) {
+            mask |= 1 << k;
+        }
+    }
+    return mask;
+}
+
+
+void Chip8Movie::setKeys(Chip8& machine, unsigned short mask) {
+    for (int k=0; k<16; k++) {
+        machine.keys[k] = (mask >> k) & 1;
+    }
+}
+
+
+unsigned long long Chip8Movie::romHash(const Chip8& machine) {
+    return Chip8::hashBytes(0x9E3779B97F4A7C15ULL, &machine.ram[512], machine.game_max_address - 512);
+}
+
+
+// The screen at its current resolution. The second plane only counts once
+// an XO-CHIP game draws on it, so other games hash their single plane.
+unsigned long long Chip8Movie::displayHash(const Chip8& machine) {
+    unsigned long long h = 0x9E3779B97F4A7C15ULL;
+    for (int p=0; p<Chip8::DISPLAY_PLANES; p++) {
+        unsigned char packed[Chip8::PACKED_HIRES_SIZE];
+        size_t size = Chip8::PACKED_DISPLAY_SIZE;
+        if (machine.hires) {
+            machine.packHires(packed, p);
+            size = Chip8::PACKED_HIRES_SIZE;
+        } else {
+            machine.packDisplay(packed, p);
+        }
+        bool empty = true;
+        for (size_t i=0; i<size && empty; i++) {
+            empty = packed[i] == 0;
+        }
+        if (p == 0 || !empty) {
+            h = Chip8::hashBytes(h, packed, size);
+        }
+    }
+    return h;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <vector>
+#include "chip8.h"
+
+
+// Unchanged frames are stored as one run: the key mask held and for how long
+struct Chip8MovieRun {
+    unsigned short keys; // bit k set while key k is down
+    unsigned int frames;
+};
+
+// Hash of the screen at a recorded frame, to catch playback going out of sync
+struct Chip8Checkpoint {
+    unsigned int frame;
+    unsigned long long display_hash;
+};
+
+
+// Recording of a play session: the keys held on every runFrame, plus what the
+// machine needs to replay it the same way (quirks, clock, random seed and
+// which game it was). Recording and playback both step with runFrame, so a
+// movie replays exactly, in the GUI or headless as fast as the host goes.
+typedef struct Chip8Movie {
+    enum { CHECKPOINT_INTERVAL = 600 }; // frames, 10 seconds of play
+
+    Chip8Quirks quirks;
+    unsigned int clock;
+    unsigned int seed;
+    unsigned long long rom_hash;
+
+    std::vector<Chip8MovieRun> runs;
+    std::vector<Chip8Checkpoint> checkpoints;
+    unsigned int frames; // total length
+
+    // playback position
+    unsigned int frame;
+    size_t run_index;
+    unsigned int run_offset;
+    size_t checkpoint_index;
+    int desync_frame; // first checkpoint that didn't match, -1 if none
+
+    Chip8Movie();
+
+    bool load(const char* fileName);
+    bool save(const char* fileName) const;
+
+    void startRecording(Chip8& machine, unsigned int seed);
+    void recordFrame(Chip8& machine);
+
+    bool startPlayback(Chip8& machine);
+    bool playFrame(Chip8& machine);
+    bool finished() const;
+
+    static unsigned short keyMask(const Chip8& machine);
+    static void setKeys(Chip8& machine, unsigned short mask);
+    static unsigned long long romHash(const Chip8& machine);
+    static unsigned long long displayHash(const Chip8& machine);
+
+} Chip8Movie;
@@ -0,0 +1,127 @@
+#include <math.h>
+#include <algorithm>
+#include <thread>
+#include "chip8_pacer.h"
+
+
+// Displays within this much of 60Hz run one frame per refresh
+static const double SNAP = 0.01;
+static const double MIN_MARGIN_US = 100;
+static const double MAX_MARGIN_US = 4000;
+
+
+Chip8Pacer::Chip8Pacer(double refresh_hz) {
+    reset(refresh_hz);
+}
+
+
+// Starts measuring again, e.g. after the window moved to another display.
+// refresh_hz is what the display reports, a guess until measured.
+void Chip8Pacer::reset(double refresh_hz) {
+    frame_us    = 1000000.0/60.0;
+    nominal_us  = 1000000.0/(refresh_hz > 0 ? refresh_hz : 60);
+    refresh_us  = nominal_us;
+    measured    = false;
+    vsync       = false;
+    credit_us   = 0;
+    last_us     = -1;
+    elapsed_us  = 0;
+    deadline_us = 0;
+    sleep_margin_us = 1000;
+    sample_count = 0;
+}
+
+
+// Frames to run before showing the next one. running is false while the game
+// is paused, which drops anything owed.
+int Chip8Pacer::framesOwed(bool running) {
+    if (!running) {
+        credit_us = 0;
+        return 0;
+    }
+    int frames;
+    if (vsync && fabs(refresh_us - frame_us) < SNAP*frame_us) {
+        credit_us = 0;
+        frames = std::max(1, (int)lround(elapsed_us / refresh_us));
+    } else {
+        if (vsync) {
+            credit_us += std::max(1L, lround(elapsed_us / refresh_us)) * refresh_us;
+        } else {
+            credit_us += elapsed_us;
+        }
+        // half a microsecond of slack so whole refreshes add up to whole frames
+        frames = (int)((credit_us + 0.5) / frame_us);
+        credit_us = std::max(0.0, credit_us - frames*frame_us);
+    }
+    elapsed_us = 0;
+
+    // a stall doesn't turn into a burst of game time
+    if (frames > MAX_FRAMES) {
+        frames = MAX_FRAMES;
+        credit_us = 0;
+    }
+    return frames;
+}
+
+
+// Call right after swapping buffers
+void Chip8Pacer::presented() {
+    if (measured && !vsync) {
+        double now_us = now();
+        if (deadline_us < now_us - frame_us) {
+            deadline_us = now_us; // too late to catch up
+        }
+        deadline_us += frame_us;
+        sleepUntil(deadline_us);
+    }
+    presentedAt(now());
+}
+
+
+void Chip8Pacer::presentedAt(double now_us) {
+    if (last_us >= 0) {
+        elapsed_us = now_us - last_us;
+        if (!measured || vsync) {
+            intervals[sample_count % SAMPLES] = elapsed_us;
+            sample_count++;
+        }
+    }
+    last_us = now_us;
+
+    if (sample_count >= SAMPLES && sample_count % SAMPLES == 0) {
+        double sorted[SAMPLES];
+        std::copy(intervals, intervals + SAMPLES, sorted);
+        std::sort(sorted, sorted + SAMPLES);
+        double sum = 0;
+        for (int i=SAMPLES/4; i<SAMPLES - SAMPLES/4; i++) {
+            sum += sorted[i];
+        }
+        double typical = sum / (SAMPLES - 2*(SAMPLES/4));
+        if (!measured) {
+            // swaps that return well within a refresh didn't wait for it
+            vsync = typical > nominal_us / 2;
+            measured = true;
+        }
+        refresh_us = vsync ? typical : frame_us;
+    }
+}
+
+
+void Chip8Pacer::sleepUntil(double target_us) {
+    double sleep_us = target_us - now() - sleep_margin_us;
+    if (sleep_us > 0) {
+        double before = now();
+        std::this_thread::sleep_for(std::chrono::duration<double, std::micro>(sleep_us));
+        double late_us = now() - before - sleep_us;
+        sleep_margin_us = std::min(MAX_MARGIN_US, std::max(MIN_MARGIN_US, std::max(late_us + 50, sleep_margin_us * 0.95)));
+    }
+    while (now() < target_us) {
+        std::this_thread::yield();
+    }
+}
+
+
+// Microseconds on a steady clock
+double Chip8Pacer::now() {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
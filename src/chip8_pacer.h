@@ -0,0 +1,50 @@
+#pragma once
+
+#include <chrono>
+
+
+// Decides how many 60Hz frames to run for each frame the GUI shows. The game
+// only runs in whole frames, so movies and the debugger's history replay
+// exactly, and the pacer owes it 1/60s of game time per frame.
+//
+// It measures the display's refresh from the time between presents: the
+// mean of the middle half of the last SAMPLES intervals, so a missed refresh
+// or a stall doesn't move it. With vsync on a display close to 60Hz, every
+// refresh runs exactly one frame (or as many as refreshes went by), locking
+// the game to the display instead of beating against it. Faster displays get
+// the frames owed for whole refreshes at the measured rate, e.g. one every
+// other refresh at 120Hz, which keeps the cadence steady where wall clock
+// time between presents jitters.
+//
+// The first SAMPLES presents also tell if swaps wait for the display at all.
+// If they don't, presented() waits for the next 60Hz deadline itself: it
+// sleeps until just before it, then spins the rest, learning how late the
+// OS wakes it up so deadlines are met within about 100us.
+typedef struct Chip8Pacer {
+    enum { SAMPLES = 31, MAX_FRAMES = 4 };
+
+    double frame_us;   // game time per frame
+    double nominal_us; // the refresh the display reports
+    double refresh_us; // the refresh measured
+    bool measured;     // SAMPLES presents went by, vsync is known
+    bool vsync;        // presents wait for the display
+    double credit_us;  // game time owed
+    double last_us;    // last present, negative before the first
+    double elapsed_us; // between the last two presents
+    double deadline_us;     // next present without vsync
+    double sleep_margin_us; // woken up at most this late, spun instead of slept
+
+    double intervals[SAMPLES];
+    int sample_count;
+
+    Chip8Pacer(double refresh_hz = 60);
+    void reset(double refresh_hz);
+
+    int framesOwed(bool running);
+    void presented();
+    void presentedAt(double now_us);
+
+    void sleepUntil(double target_us);
+    static double now();
+
+} Chip8Pacer;
@@ -0,0 +1,217 @@
+#include <errno.h>
+#include <stdio.h>
+#include "chip8_stats.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#define CHIP8_STATS_SHM 1
+#endif
+
+
+Chip8Stats::Chip8Stats() {
+    header = NULL;
+    slots  = NULL;
+    size   = 0;
+    writer = false;
+    name[0] = 0;
+}
+
+
+Chip8Stats::~Chip8Stats() {
+    close();
+}
+
+
+#ifdef CHIP8_STATS_SHM
+static std::atomic<unsigned int> segments_opened(0);
+#endif
+
+
+// Creates a new segment with room for the given instances. Never reuses an
+// existing one: a name left behind by a process that had the same pid is
+// skipped for the next.
+bool Chip8Stats::open(unsigned int instances) {
+    close();
+#ifdef CHIP8_STATS_SHM
+    size = sizeof(Chip8StatsHeader) + instances*sizeof(Chip8StatsSlot);
+    int fd = -1;
+    for (int tries=0; tries<64 && fd < 0; tries++) {
+        snprintf(name, sizeof(name), "/chip8-stats-%u-%u", (unsigned int)getpid(), segments_opened++);
+        fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+        if (fd < 0 && errno != EEXIST) {
+            break;
+        }
+    }
+    if (fd < 0) {
+        return false;
+    }
+    void* memory = MAP_FAILED;
+    if (ftruncate(fd, size) == 0) {
+        memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (memory == MAP_FAILED) {
+        shm_unlink(name);
+        return false;
+    }
+
+    // zero filled by ftruncate, which is a valid state for every slot
+    header = (Chip8StatsHeader*)memory;
+    slots  = (Chip8StatsSlot*)(header + 1);
+    writer = true;
+    local.assign(instances, Chip8StatsLocal());
+    header->version   = VERSION;
+    header->pid       = getpid();
+    header->instances = instances;
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(header->magic, "C8STATS", 8); // readers check it last
+    return true;
+#else
+    (void)instances;
+    return false;
+#endif
+}
+
+
+// Maps another process's segment, read only. segment is its name, e.g.
+// /chip8-stats-1234-0.
+bool Chip8Stats::attach(const char* segment) {
+    close();
+#ifdef CHIP8_STATS_SHM
+    int fd = shm_open(segment, O_RDONLY, 0);
+    if (fd < 0) {
+        return false;
+    }
+    off_t length = lseek(fd, 0, SEEK_END);
+    void* memory = MAP_FAILED;
+    if (length >= (off_t)sizeof(Chip8StatsHeader)) {
+        memory = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (memory == MAP_FAILED) {
+        return false;
+    }
+
+    header = (Chip8StatsHeader*)memory;
+    size = length;
+    if (memcmp(header->magic, "C8STATS", 8) != 0 || header->version != VERSION
+        || sizeof(Chip8StatsHeader) + header->instances*sizeof(Chip8StatsSlot) > size) {
+        close();
+        return false;
+    }
+    slots = (Chip8StatsSlot*)(header + 1);
+    snprintf(name, sizeof(name), "%s", segment);
+    return true;
+#else
+    (void)segment;
+    return false;
+#endif
+}
+
+
+void Chip8Stats::close() {
+#ifdef CHIP8_STATS_SHM
+    if (header) {
+        munmap(header, size);
+        if (writer) {
+            shm_unlink(name);
+        }
+    }
+#endif
+    header = NULL;
+    slots  = NULL;
+    size   = 0;
+    writer = false;
+    local.clear();
+}
+
+
+bool Chip8Stats::active() const {
+    return header != NULL;
+}
+
+
+// How much a machine counter grew since the last record. One that went back
+// belongs to a machine rewound to an earlier state, replayed work isn't new.
+static unsigned long long moved(unsigned long long& last, unsigned long long now) {
+    unsigned long long delta = now >= last ? now - last : 0;
+    last = now;
+    return delta;
+}
+
+
+// Call from the thread running the instance, after it ran some frames that
+// took frame_us each on average
+void Chip8Stats::record(int instance, const Chip8& machine, unsigned int frame_us, unsigned int frames) {
+    if (!writer) {
+        return;
+    }
+    Chip8StatsCounters& c = local[instance].counters;
+    Chip8StatsCounters& seen = local[instance].seen;
+    c.instructions += moved(seen.instructions, machine.instructions);
+    c.frames       += moved(seen.frames, machine.frames);
+    c.draws        += moved(seen.draws, machine.draws);
+    c.idle         += moved(seen.idle, machine.key_waits);
+    int bucket = frame_us == 0 ? 0 : 31 - __builtin_clz(frame_us);
+    c.frame_time[bucket < Chip8StatsCounters::FRAME_TIME_BUCKETS ? bucket : Chip8StatsCounters::FRAME_TIME_BUCKETS - 1] += frames;
+    publish(instance);
+}
+
+
+// The instance's machine was reset or replaced, its counters start over
+void Chip8Stats::restart(int instance) {
+    if (writer) {
+        local[instance].seen = Chip8StatsCounters();
+    }
+}
+
+
+// Published with the next record
+void Chip8Stats::setAudioUnderruns(int instance, unsigned long long total) {
+    if (writer) {
+        local[instance].counters.audio_underruns = total;
+    }
+}
+
+
+void Chip8Stats::publish(int instance) {
+    Chip8StatsSlot& slot = slots[instance];
+    unsigned long long words[Chip8StatsSlot::WORDS];
+    memcpy(words, &local[instance].counters, sizeof(words));
+
+    unsigned int sequence = slot.sequence.load(std::memory_order_relaxed);
+    slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (int i=0; i<Chip8StatsSlot::WORDS; i++) {
+        slot.words[i].store(words[i], std::memory_order_relaxed);
+    }
+    slot.sequence.store(sequence + 2, std::memory_order_release);
+}
+
+
+// A consistent copy of an instance's counters. Only fails if the instance
+// doesn't exist or the writer was updating it on every try.
+bool Chip8Stats::read(int instance, Chip8StatsCounters& out) const {
+    if (!header || instance < 0 || instance >= (int)header->instances) {
+        return false;
+    }
+    const Chip8StatsSlot& slot = slots[instance];
+    unsigned long long words[Chip8StatsSlot::WORDS];
+    for (int tries=0; tries<1000; tries++) {
+        unsigned int before = slot.sequence.load(std::memory_order_acquire);
+        if (before & 1) {
+            continue;
+        }
+        for (int i=0; i<Chip8StatsSlot::WORDS; i++) {
+            words[i] = slot.words[i].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) == before) {
+            memcpy(&out, words, sizeof(out));
+            return true;
+        }
+    }
+    return false;
+}
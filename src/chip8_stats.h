@@ -0,0 +1,84 @@
+#pragma once
+
+#include <string.h>
+#include <atomic>
+#include <vector>
+#include "chip8.h"
+
+
+// One instance's counters, as published
+struct Chip8StatsCounters {
+    enum { FRAME_TIME_BUCKETS = 16 }; // bucket i counts frames of [2^i, 2^(i+1)) us, the last one open ended
+
+    unsigned long long instructions;
+    unsigned long long frames;
+    unsigned long long draws;           // Dxyn run
+    unsigned long long idle;            // instructions spent in Fx0A waiting for a key
+    unsigned long long audio_underruns; // reported by the front end
+    unsigned long long frame_time[FRAME_TIME_BUCKETS];
+};
+
+
+// An instance's place in the segment. Slots are cache line aligned, so
+// instances stepped on different threads don't share lines. The sequence is
+// odd while the writer updates the counters, readers retry until they copy
+// them under the same even sequence (a seqlock): the writer never waits.
+struct alignas(64) Chip8StatsSlot {
+    enum { WORDS = sizeof(Chip8StatsCounters) / sizeof(unsigned long long) };
+
+    std::atomic<unsigned int> sequence;
+    std::atomic<unsigned long long> words[WORDS]; // a Chip8StatsCounters
+};
+
+
+// The writer's own counters for an instance: the totals being published and
+// the machine counters at the last record. Padded to whole cache lines, so
+// writers on different threads don't share lines here either.
+struct alignas(64) Chip8StatsLocal {
+    Chip8StatsCounters counters;
+    Chip8StatsCounters seen;
+};
+
+
+struct alignas(64) Chip8StatsHeader {
+    char magic[8]; // "C8STATS"
+    unsigned int version;
+    unsigned int pid;
+    unsigned int instances; // slots after the header
+};
+
+
+// Counters of running machines, published to a POSIX shared memory segment
+// named /chip8-stats-<pid>-<n> so other processes can watch them live (see the
+// chip8_stats tool). n counts the segments the process opened, so each open
+// gets a segment of its own. Each instance has one writer: the thread that runs it
+// calls record after its frames, which adds what the machine's counters moved
+// by and publishes them with a few relaxed stores. Totals keep growing across
+// machine resets, which the writer reports with restart. Readers attach to a
+// segment by name and read consistent copies of any instance.
+typedef struct Chip8Stats {
+    enum { VERSION = 1 };
+
+    Chip8StatsHeader* header;
+    Chip8StatsSlot* slots;
+    size_t size;
+    bool writer;  // created the segment, and removes it on close
+    char name[32];
+    std::vector<Chip8StatsLocal> local; // writer's own copy of every instance
+
+    Chip8Stats();
+    ~Chip8Stats();
+
+    bool open(unsigned int instances);
+    bool attach(const char* segment);
+    void close();
+    bool active() const;
+
+    void record(int instance, const Chip8& machine, unsigned int frame_us, unsigned int frames = 1);
+    void restart(int instance);
+    void setAudioUnderruns(int instance, unsigned long long total);
+    bool read(int instance, Chip8StatsCounters& out) const;
+
+    void publish(int instance);
+
+} Chip8Stats;
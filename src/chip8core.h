@@ -0,0 +1,12 @@
+#pragma once
+
+// Public header of the chip8core library: the interpreter, the Gym style
+// environment, movie recording, the reverse debugging history, the
+// disassembler and GIF capture.
+
+#include "chip8.h"
+#include "chip8_env.h"
+#include "chip8_movie.h"
+#include "chip8_history.h"
+#include "chip8_disasm.h"
+#include "chip8_capture.h"
@@ -3,11 +3,22 @@
 #include "minisdl_audio.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <atomic>
 #include <chrono>
 #include "chip8.h"
+#include "chip8_movie.h"
+#include "chip8_history.h"
+#include "chip8_disasm.h"
+#include "chip8_capture.h"
+#include "chip8_stats.h"
+#include "chip8_pacer.h"
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
 #include "imgui_impl_opengl3.h"
+#include "imgui_memory_editor.h"
 #include "GL/gl3w.h"    // This example is using gl3w to access OpenGL functions (because it is small). You may use glew/glad/glLoadGen/etc. whatever already works for you.
 #include <GLFW/glfw3.h>
 
@@ -32,14 +43,53 @@ const static unsigned char MinimalSoundFont[] =
 // Holds the global instance pointer
 static tsf* g_TinySoundFont;
 
+// XO-CHIP games play their own 1 bit audio pattern instead of the soundfont.
+// Copied from the machine every frame, with the audio thread locked out.
+static struct {
+    bool enabled;
+    unsigned char pattern[16];
+    double step;     // pattern bits per output sample
+    double position; // bit being played
+} g_Pattern;
+
+// Buffers the audio thread asked for late, for --stats. A callback that
+// comes more than one and a half buffers after the previous one let the
+// device run dry. The first one after the sound starts has no previous.
+static struct {
+    std::atomic<unsigned int> count;
+    std::atomic<bool> restart;
+    double buffer_us;
+    std::chrono::time_point<std::chrono::steady_clock> last;
+} g_Underruns;
+
 // Callback function called by the audio thread
 static void AudioCallback(void* data, Uint8 *stream, int len)
 {
+	auto now = std::chrono::steady_clock::now();
+	if (!g_Underruns.restart.exchange(false)
+	    && std::chrono::duration<double, std::micro>(now - g_Underruns.last).count() > 1.5*g_Underruns.buffer_us) {
+		g_Underruns.count++;
+	}
+	g_Underruns.last = now;
+
 	// Note we don't do any thread concurrency control here because in this
 	// example all notes are started before the audio playback begins.
 	// If you do play notes while the audio thread renders output you
 	// will need a mutex of some sort.
 	int SampleCount = (len / (2 * sizeof(short))); //2 output channels
+	if (g_Pattern.enabled) {
+		short* out = (short*)stream;
+		for (int i=0; i<SampleCount; i++) {
+			int bit = (int)g_Pattern.position;
+			short value = (g_Pattern.pattern[bit >> 3] >> (7 - (bit & 7))) & 1 ? 4000 : -4000;
+			out[2*i] = out[2*i + 1] = value;
+			g_Pattern.position += g_Pattern.step;
+			if (g_Pattern.position >= 128) {
+				g_Pattern.position -= 128;
+			}
+		}
+		return;
+	}
 	tsf_render_short(g_TinySoundFont, (short*)stream, SampleCount, 0);
 }
 
@@ -76,19 +126,264 @@ void inputKeys(Chip8& chip8, ImGuiIO& io, int keyboardKey, int keyId) {
 }
 
 
+// Address typed in one of the debugger's hex fields
+static unsigned short parseAddress(const Chip8& chip8, const char* text) {
+    return (unsigned short)strtol(text, NULL, 16) & chip8.ramMask();
+}
+
+
+// Breakpoints and watchpoints by address, the machine only points at them
+static unsigned char debugger_flags[Chip8::RAM_SIZE];
+
+
+// Breakpoints, watchpoints and stepping. The game only runs while it isn't
+// paused or stopped by the debugger. Without a history (while a movie
+// records or plays) it only pauses between frames: stepping or stopping
+// inside one would throw the movie's frames off.
+static void debuggerWindow(Chip8& chip8, Chip8History* history, bool& paused) {
+    static char cursor_text[5] = "200";
+    static char address_text[5] = "200";
+
+    ImGui::SetNextWindowPos(ImVec2(660, 10), ImGuiCond_FirstUseEver);
+    ImGui::Begin("Debugger");
+
+    if (chip8.debug_break.active) {
+        const Chip8Break& stop = chip8.debug_break;
+        if (stop.reason == DEBUG_READ) {
+            ImGui::Text("Stopped at %#06x, reading %#06x", stop.pc, stop.address);
+        } else if (stop.reason == DEBUG_WRITE) {
+            ImGui::Text("Stopped at %#06x, writing %#06x", stop.pc, stop.address);
+        } else {
+            ImGui::Text("Stopped at %#06x", stop.pc);
+        }
+    } else {
+        ImGui::Text(paused ? "Paused at %#06x" : "Running", chip8.pc);
+    }
+
+    if (paused || chip8.debug_break.active) {
+        if (ImGui::Button("Continue")) {
+            chip8.resume();
+            paused = false;
+        }
+    } else if (ImGui::Button("Pause")) {
+        paused = true;
+    }
+    if (!history) {
+        ImGui::TextDisabled("No stepping, breakpoints or watches while a movie records or plays");
+        ImGui::End();
+        return;
+    }
+
+    ImGui::SameLine();
+    if (ImGui::Button("Step")) {
+        paused = true;
+        chip8.step();
+        history->stepped(chip8);
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Step back")) {
+        paused = true;
+        history->stepBack(chip8);
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Continue back")) {
+        paused = true;
+        history->continueBack(chip8);
+    }
+    ImGui::Text("Instruction %llu, history from %llu", chip8.instructions, history->oldest());
+
+    ImGui::PushItemWidth(48);
+    ImGui::InputText("##cursor", cursor_text, sizeof(cursor_text), ImGuiInputTextFlags_CharsHexadecimal | ImGuiInputTextFlags_CharsUppercase);
+    ImGui::SameLine();
+    if (ImGui::Button("Run to cursor")) {
+        unsigned short address = parseAddress(chip8, cursor_text);
+        chip8.setDebugFlags(address, chip8.debug_flags[address] | DEBUG_CURSOR);
+        chip8.resume();
+        paused = false;
+    }
+
+    ImGui::Separator();
+    ImGui::InputText("##address", address_text, sizeof(address_text), ImGuiInputTextFlags_CharsHexadecimal | ImGuiInputTextFlags_CharsUppercase);
+    ImGui::PopItemWidth();
+    unsigned short address = parseAddress(chip8, address_text);
+    ImGui::SameLine();
+    if (ImGui::Button("Break")) {
+        chip8.setDebugFlags(address, chip8.debug_flags[address] | DEBUG_BREAK);
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Watch read")) {
+        chip8.setDebugFlags(address, chip8.debug_flags[address] | DEBUG_READ);
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Watch write")) {
+        chip8.setDebugFlags(address, chip8.debug_flags[address] | DEBUG_WRITE);
+    }
+
+    // the profile's memory to scan (4KB, 64KB on XO-CHIP), only while the
+    // window is open
+    for (int i=0; i<(int)chip8.memorySize(); i++) {
+        unsigned char flags = chip8.debug_flags[i] & (DEBUG_BREAK | DEBUG_READ | DEBUG_WRITE);
+        if (flags == 0) {
+            continue;
+        }
+        ImGui::PushID(i);
+        if (ImGui::SmallButton("x")) {
+            chip8.setDebugFlags(i, chip8.debug_flags[i] & DEBUG_CURSOR);
+        }
+        ImGui::SameLine();
+        ImGui::Text("%#06x %s%s%s", i, flags & DEBUG_BREAK ? "break " : "", flags & DEBUG_READ ? "read " : "", flags & DEBUG_WRITE ? "write" : "");
+        ImGui::PopID();
+    }
+
+    ImGui::End();
+}
+
+
+// Registers, stack and timers, and the disassembly around pc: the line at pc
+// is marked with >, breakpoints with *. Lines come from a cache that only
+// decodes an address again once its bytes change.
+static void cpuWindow(const Chip8& chip8) {
+    static Chip8Disassembly disassembly;
+
+    ImGui::SetNextWindowPos(ImVec2(660, 300), ImGuiCond_FirstUseEver);
+    ImGui::Begin("CPU");
+
+    for (int i=0; i<16; i++) {
+        ImGui::Text("V%X %02X", i, chip8.V[i]);
+        if (i % 4 != 3) {
+            ImGui::SameLine();
+        }
+    }
+    ImGui::Text("I %04X  pc %04X  SP %X  DT %02X  ST %02X", chip8.I, chip8.pc, chip8.stack_pointer, chip8.delay_timer, chip8.sound_timer);
+    ImGui::Text("Stack");
+    for (int i=chip8.stack_pointer - 1; i>=0; i--) {
+        ImGui::SameLine();
+        ImGui::Text("%04X", chip8.stack[i]);
+    }
+
+    ImGui::Separator();
+    for (int i=-8; i<24; i++) {
+        unsigned short address = (chip8.pc + 2*i) & chip8.ramMask();
+        const char* marker = address == chip8.pc ? ">" : chip8.debug_flags[address] & DEBUG_BREAK ? "*" : " ";
+        ImGui::Text("%s %04X  %02X%02X  %s", marker, address, chip8.ram[address], chip8.ram[(address + 1) & chip8.ramMask()],
+                    disassembly.line(chip8, address));
+    }
+
+    ImGui::End();
+}
+
+
+// Memory viewer. Bytes the game stored in the last second light up, as do
+// the instruction at pc and the 16 bytes from I, the most that Dxyn, Fx55 and
+// Fx65 reach. MemoryEditor's hooks take no user data, hence the statics.
+// Without a history (while a movie records or plays) memory is read only. An
+// edit can't be replayed from the snapshots taken before it, so history
+// starts over from the edited machine.
+#define MEMORY_HIGHLIGHT_FRAMES 60
+static Chip8* memory_machine;
+static Chip8History* memory_history;
+static unsigned int memory_write_frames[Chip8::RAM_SIZE];
+
+static bool memoryHighlight(const unsigned char* data, size_t off) {
+    const Chip8& chip8 = *memory_machine;
+    if (off - chip8.pc < 2 || off - chip8.I < 16) {
+        return true;
+    }
+    unsigned int written = memory_write_frames[off];
+    return written != 0 && chip8.frames + 1 - written < MEMORY_HIGHLIGHT_FRAMES;
+}
+
+static void memoryWrite(unsigned char* data, size_t off, unsigned char value) {
+    memory_machine->poke(off, value);
+    memory_history->reset(*memory_machine);
+}
+
+static void memoryWindow(Chip8& chip8, Chip8History* history) {
+    static MemoryEditor editor;
+    memory_machine = &chip8;
+    memory_history = history;
+    chip8.write_frames = memory_write_frames;
+    editor.ReadOnly = history == NULL;
+    editor.HighlightFn = memoryHighlight;
+    editor.WriteFn = memoryWrite;
+
+    ImGui::SetNextWindowPos(ImVec2(10, 380), ImGuiCond_FirstUseEver);
+    editor.DrawWindow("Memory", chip8.ram, chip8.memorySize());
+}
+
+
 int main(int argc, char* argv[]) {
-    if (argc != 2) {
-        printf("Usage: ./chip8 path/to/game/awesomegame\n");
+    if (argc < 2) {
+        printf("Usage: ./chip8 path/to/game/awesomegame [chip8|cosmac|schip|xochip] [--record movie | --play movie] [--capture out.gif] [--stats]\n");
         return 0;
     }
 
-    unsigned char image_buffer[32][64*3];
+    Chip8Quirks quirks = QUIRKS_CHIP8;
+    const char* record_file = NULL;
+    const char* play_file = NULL;
+    const char* capture_file = NULL;
+    bool publish = false;
+    for (int i=2; i<argc; i++) {
+        if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            record_file = argv[++i];
+        } else if (strcmp(argv[i], "--play") == 0 && i + 1 < argc) {
+            play_file = argv[++i];
+        } else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+            capture_file = argv[++i];
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            publish = true;
+        } else if (strcmp(argv[i], "cosmac") == 0) {
+            quirks = QUIRKS_COSMAC;
+        } else if (strcmp(argv[i], "schip") == 0) {
+            quirks = QUIRKS_SCHIP;
+        } else if (strcmp(argv[i], "xochip") == 0) {
+            quirks = QUIRKS_XOCHIP;
+        } else if (strcmp(argv[i], "chip8") != 0) {
+            printf("Unknown option or quirks profile: %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    // a movie plays with the quirks it was recorded with, which also decide
+    // how much of the game fits in memory
+    Chip8Movie movie;
+    if (play_file) {
+        if (!movie.load(play_file)) {
+            printf("Problem loading the provided movie: %s\n", play_file);
+            return 1;
+        }
+        quirks = movie.quirks;
+    }
+
+    unsigned char image_buffer[Chip8::DISPLAY_HEIGHT][Chip8::DISPLAY_WIDTH*3];
     Chip8 chip8;
-    if (chip8.loadGame(argv[1]) == false)
+    if (chip8.loadGame(argv[1], quirks) == false)
     {
         printf("Problem loading the provided game: %s\n", argv[1]);
         return 1;
     }
+    chip8.debug_flags = debugger_flags;
+
+    if (play_file) {
+        if (!movie.startPlayback(chip8)) {
+            printf("The movie was recorded on another game\n");
+            return 1;
+        }
+    } else if (record_file) {
+        movie.startRecording(chip8, (unsigned int)time(NULL));
+    }
+    Chip8History history;
+    history.reset(chip8);
+    Chip8Capture capture;
+    if (capture_file && !capture.start(capture_file, chip8)) {
+        printf("Could not write the capture to %s\n", capture_file);
+        return 1;
+    }
+    Chip8Stats stats;
+    if (publish && !stats.open(1)) {
+        printf("Could not publish stats\n");
+        return 1;
+    }
     float im_scale = 10.0;
 
 
@@ -100,6 +395,8 @@ int main(int argc, char* argv[]) {
 	OutputAudioSpec.channels = 2;
 	OutputAudioSpec.samples = 4096;
 	OutputAudioSpec.callback = AudioCallback;
+	g_Underruns.buffer_us = 1000000.0 * OutputAudioSpec.samples / OutputAudioSpec.freq;
+	g_Underruns.restart = true;
 
 	// Initialize the audio system
 	if (SDL_AudioInit(NULL) < 0)
@@ -194,6 +491,13 @@ int main(int argc, char* argv[]) {
     
     GLuint textureID = CreateTexture(); // Just using one texture. Avoiding texture memory leak.
 
+    // the game runs in whole 60Hz frames so recordings replay exactly, as
+    // many for each frame shown as the display's refresh owes it
+    const GLFWvidmode* video_mode = glfwGetVideoMode(glfwGetPrimaryMonitor());
+    Chip8Pacer pacer(video_mode ? video_mode->refreshRate : 60);
+    bool paused = false;
+    bool sounding = false;
+
     while (!glfwWindowShouldClose(window))
     {
         glfwPollEvents();
@@ -201,42 +505,6 @@ int main(int argc, char* argv[]) {
         ImGui_ImplGlfw_NewFrame();
         ImGui::NewFrame();
 
-        // we must run this until 1/60 of the cpu cicles have finished, and since
-        // the timers are updated on the same frequency I'm using them to keep track  
-        auto begin = std::chrono::high_resolution_clock::now();
-        std::chrono::duration<double, std::micro> ellapsed_time;
-        do {
-            chip8.runStep();
-            if (chip8.sound_timer > 1) {
-                SDL_PauseAudio(0);
-            } else {
-                SDL_PauseAudio(1);
-            }
-            ellapsed_time = std::chrono::high_resolution_clock::now()-begin;
-        } while ((float)ellapsed_time.count() < 1000000/60);
-        if (chip8.display_updated) {
-            for (int i=0; i<32; i++) {
-                for (int j=0; j<64; j++) {
-                    image_buffer[i][j*3+0] = 255*chip8.display[i][j];
-                    image_buffer[i][j*3+1] = 255*chip8.display[i][j];
-                    image_buffer[i][j*3+2] = 255*chip8.display[i][j];
-                }
-            }
-            TextureFromMat(image_buffer[0], 64, 32); 
-            chip8.display_updated = false;
-        }
-        
-        {
-            ImGui::SetNextWindowPos(ImVec2(0,0));
-            ImGui::Begin("Chip8", NULL, ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_MenuBar | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove |  ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_NoBackground | ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_HorizontalScrollbar );   
-            auto size = ImGui::GetWindowSize();
-            ImGui::SetNextWindowSize(ImVec2(size.x, size.y));
-            ImGui::Image((GLuint*)textureID, ImVec2(64*im_scale,32*im_scale));        
-            ImGui::End();
-        }
-
-
-        
         inputKeys(chip8, io, 49, 1);
         inputKeys(chip8, io, 50, 2);
         inputKeys(chip8, io, 51, 3);
@@ -257,6 +525,84 @@ int main(int argc, char* argv[]) {
         inputKeys(chip8, io, 67, 11);
         inputKeys(chip8, io, 86, 15);
 
+        int frames = pacer.framesOwed(!paused && !chip8.debug_break.active);
+        for (int f=0; f<frames && !chip8.debug_break.active; f++) {
+            auto frame_begin = std::chrono::high_resolution_clock::now();
+            if (play_file) {
+                movie.playFrame(chip8); // the recorded keys replace the keyboard
+            } else if (record_file) {
+                movie.recordFrame(chip8);
+            } else {
+                chip8.runFrame();
+                history.frameDone(chip8);
+            }
+            capture.frame(chip8);
+            if (publish) {
+                std::chrono::duration<double, std::micro> frame_time = std::chrono::high_resolution_clock::now() - frame_begin;
+                stats.setAudioUnderruns(0, g_Underruns.count);
+                stats.record(0, chip8, (unsigned int)frame_time.count());
+            }
+        }
+        if (chip8.quirks == QUIRKS_XOCHIP) {
+            SDL_LockAudio();
+            g_Pattern.enabled = true;
+            memcpy(g_Pattern.pattern, chip8.audio_pattern, sizeof(g_Pattern.pattern));
+            g_Pattern.step = chip8.audioRate() / OutputAudioSpec.freq;
+            SDL_UnlockAudio();
+        }
+        if (chip8.sound_timer > 1) {
+            if (!sounding) {
+                g_Underruns.restart = true; // the gap since it last played was a pause
+            }
+            SDL_PauseAudio(0);
+        } else {
+            SDL_PauseAudio(1);
+        }
+        sounding = chip8.sound_timer > 1;
+        if (chip8.display_updated) {
+            // always 128x64, low resolution pixels doubled, the colours of
+            // XO-CHIP's second plane in grey as in the GIF captures
+            static const unsigned char palette[4] = { 0, 255, 85, 170 };
+            int shift = chip8.hires ? 0 : 1;
+            for (int i=0; i<Chip8::DISPLAY_HEIGHT; i++) {
+                for (int j=0; j<Chip8::DISPLAY_WIDTH; j++) {
+                    unsigned char value = palette[chip8.pixel(j >> shift, i >> shift)];
+                    image_buffer[i][j*3+0] = value;
+                    image_buffer[i][j*3+1] = value;
+                    image_buffer[i][j*3+2] = value;
+                }
+            }
+            TextureFromMat(image_buffer[0], Chip8::DISPLAY_WIDTH, Chip8::DISPLAY_HEIGHT);
+            chip8.display_updated = false;
+        }
+        
+        {
+            ImGui::SetNextWindowPos(ImVec2(0,0));
+            ImGui::Begin("Chip8", NULL, ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_MenuBar | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove |  ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_NoBackground | ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_HorizontalScrollbar );   
+            auto size = ImGui::GetWindowSize();
+            ImGui::SetNextWindowSize(ImVec2(size.x, size.y));
+            ImGui::Image((GLuint*)textureID, ImVec2(64*im_scale,32*im_scale));        
+            if (chip8.fault.active) {
+                ImGui::Text("Stopped at %#06x, opcode %#06x: %s", chip8.fault.pc, chip8.fault.opcode, chip8.fault.reason);
+            }
+            if (play_file) {
+                ImGui::Text("Playing frame %u/%u", movie.frame, movie.frames);
+                if (movie.desync_frame >= 0) {
+                    ImGui::Text("Out of sync with the recording at frame %d", movie.desync_frame);
+                }
+            } else if (record_file) {
+                ImGui::Text("Recording frame %u", movie.frames);
+            }
+            if (capture.active()) {
+                ImGui::Text("Capturing frame %u to %s, %u screens dropped", capture.frames, capture_file, capture.dropped);
+            }
+            ImGui::End();
+        }
+
+        debuggerWindow(chip8, play_file || record_file ? NULL : &history, paused);
+        cpuWindow(chip8);
+        memoryWindow(chip8, play_file || record_file ? NULL : &history);
+
 
         // Rendering
         ImGui::Render();
@@ -270,7 +616,13 @@ int main(int argc, char* argv[]) {
 
         glfwMakeContextCurrent(window);
         glfwSwapBuffers(window);
+        pacer.presented();
+    }
+
+    if (record_file && !movie.save(record_file)) {
+        fprintf(stderr, "Could not save the movie to %s\n", record_file);
     }
+    capture.stop();
 
     // Cleanup
     ImGui_ImplOpenGL3_Shutdown();
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+
+
+// Fixed set of worker threads splitting a range of indices between them.
+// Jobs are a plain function and context pointer, so running one doesn't
+// allocate.
+class ThreadPool {
+public:
+    typedef void (*Job)(void* context, int begin, int end);
+
+    // threads <= 0 uses one per core
+    explicit ThreadPool(int threads = 0) {
+        if (threads <= 0) {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        job = NULL;
+        generation = 0;
+        pending = 0;
+        stopping = false;
+        // the calling thread takes a share too
+        for (int i=1; i<threads; i++) {
+            workers.push_back(std::thread(&ThreadPool::work, this, i));
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (size_t i=0; i<workers.size(); i++) {
+            workers[i].join();
+        }
+    }
+
+    int size() const {
+        return (int)workers.size() + 1;
+    }
+
+    // Calls job(context, begin, end) over [0, count) split in one contiguous
+    // chunk per thread, and waits for all of them.
+    void run(Job job, void* context, int count) {
+        if (workers.empty() || count <= 1) {
+            job(context, 0, count);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            this->job = job;
+            this->context = context;
+            this->count = count;
+            pending = (int)workers.size();
+            generation++;
+        }
+        wake.notify_all();
+
+        runChunk(0);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return pending == 0; });
+    }
+
+private:
+    void runChunk(int index) {
+        int threads = size();
+        int begin = (int)((long long)count * index / threads);
+        int end = (int)((long long)count * (index + 1) / threads);
+        if (begin < end) {
+            job(context, begin, end);
+        }
+    }
+
+    void work(int index) {
+        unsigned long long seen = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping) {
+                    return;
+                }
+                seen = generation;
+            }
+
+            runChunk(index);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--pending == 0) {
+                done.notify_one();
+            }
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+
+    Job job;
+    void* context;
+    int count;
+    unsigned long long generation;
+    int pending;
+    bool stopping;
+};
@@ -1,3 +1,6 @@
 #define CATCH_CONFIG_MAIN
+// The bundled Catch2 sizes its alternate signal stack with MINSIGSTKSZ, which
+// is no longer a constant on recent glibc versions
+#define CATCH_CONFIG_NO_POSIX_SIGNALS
 
 #include "catch2/catch.hpp"
@@ -1,3 +1,4 @@
+#include <vector>
 #include "chip8.h"
 #include "catch2/catch.hpp"
 
@@ -7,11 +8,42 @@ Chip8 chip8;
 void prepare_test(unsigned short op) {
     chip8.ram[512] = (op & 0xFF00) >> 8;
     chip8.ram[513] = op & 0x00FF;
+    for (int i=514; i<520; i++) chip8.ram[i] = 0;
     chip8.pc = 512;
     chip8.game_max_address = 1024;
     chip8.stack_pointer = 0;
     chip8.I = 0x0000;
     for (int i=0; i<16; i++) chip8.keys[i] = 0;
+    chip8.clearFault();
+}
+
+// Load a game from memory.
+TEST_CASE( "loadRom" ) {
+    Chip8 fresh;
+    unsigned char game[4] = { 0x60, 0x2A, 0x12, 0x02 };
+
+    REQUIRE( fresh.loadRom(game, sizeof(game)) == true );
+    REQUIRE( fresh.game_max_address == 516 );
+    REQUIRE( fresh.ram[513] == 0x2A );
+
+    fresh.execute();
+    REQUIRE( fresh.V[0] == 0x2A );
+
+    // 4KB of memory, 64KB on XO-CHIP
+    static unsigned char too_big[Chip8::RAM_SIZE];
+    REQUIRE( fresh.loadRom(too_big, Chip8::CLASSIC_RAM_SIZE - 512 + 1) == false );
+    REQUIRE( fresh.loadRom(too_big, Chip8::CLASSIC_RAM_SIZE - 512) == true );
+    REQUIRE( fresh.loadRom(too_big, Chip8::RAM_SIZE - 512, QUIRKS_XOCHIP) == true );
+    REQUIRE( fresh.loadRom(too_big, Chip8::RAM_SIZE - 512 + 1, QUIRKS_XOCHIP) == false );
+
+    // over a copy of a blank machine, only the game is hashed, to the same
+    Chip8 blank, loaded, reference;
+    blank.loadRom(game, 0, QUIRKS_SCHIP);
+    loaded.restore(blank);
+    REQUIRE( loaded.loadRom(game, sizeof(game), QUIRKS_SCHIP) == true );
+    REQUIRE( reference.loadRom(game, sizeof(game), QUIRKS_SCHIP) == true );
+    REQUIRE( loaded.stateHash() == reference.stateHash() );
+    REQUIRE( loaded.stateHash() != blank.stateHash() );
 }
 
 // Clear screen
@@ -19,7 +51,7 @@ TEST_CASE( "00E0 - CLS" ) {
     prepare_test(0x00E0);
     for (int i=0; i<32; i++) {
         for (int j=0; j<64; j++) {
-            chip8.display[i][j] = 27; 
+            chip8.setPixel(j, i, true);
         }
     }
 
@@ -28,7 +60,7 @@ TEST_CASE( "00E0 - CLS" ) {
     bool all_blank = true;
     for (int i=0; i<32; i++) {
         for (int j=0; j<64; j++) {
-            if (chip8.display[i][j] > 0) {
+            if (chip8.pixel(j, i)) {
                 all_blank = false;
             }
         }
@@ -37,6 +69,16 @@ TEST_CASE( "00E0 - CLS" ) {
     REQUIRE( all_blank == true );
 }
 
+// Jump to a machine code routine at nnn, ignored by interpreters.
+TEST_CASE( "0nnn - SYS addr" ) {
+    prepare_test(0x0123);
+
+    chip8.runStep();
+
+    REQUIRE( chip8.pc == 514 );
+    REQUIRE( chip8.fault.active == false );
+}
+
 // Return from a subroutine.
 TEST_CASE( "00EE - RET" ) {
     prepare_test(0x00EE);
@@ -331,9 +373,9 @@ TEST_CASE( "Cxkk - RND Vx, byte" ) {
 
     prepare_test(0xC000 | (x << 8) | kk);
     chip8.V[x] = vx;
-    srand(42);
+    chip8.seed(42);
     chip8.runStep();
-    REQUIRE( chip8.V[x] == 0x0006 );
+    REQUIRE( chip8.V[x] == 0x0036 );
 }
 
 // Display n-byte sprite starting at memory location I at (Vx, Vy), set VF = collision.
@@ -375,3 +417,929 @@ TEST_CASE( "ExA1 - SKNP Vx" ) {
     chip8.runStep();
     REQUIRE( chip8.pc == old_pc+2 );
 }
+
+
+// Skip next instruction if Vx = kk, fused with the JP that follows it.
+TEST_CASE( "Superinstruction - SE Vx, byte + JP addr" ) {
+    unsigned short x  = 0x0004;
+    unsigned short kk = 0x0011;
+
+    // skip taken: the jump is not executed
+    prepare_test(0x3000 | (x << 8) | kk);
+    chip8.ram[514] = 0x13;
+    chip8.ram[515] = 0x45;
+    chip8.V[x] = kk;
+    unsigned int cycles = chip8.execute();
+    REQUIRE( chip8.pc == 516 );
+    REQUIRE( cycles == 1 );
+
+    // skip not taken: both instructions run on the same dispatch
+    prepare_test(0x3000 | (x << 8) | kk);
+    chip8.ram[514] = 0x13;
+    chip8.ram[515] = 0x45;
+    chip8.V[x] = kk+1;
+    cycles = chip8.execute();
+    REQUIRE( chip8.pc == 0x0345 );
+    REQUIRE( cycles == 2 );
+
+    // same, with superinstructions disabled
+    prepare_test(0x3000 | (x << 8) | kk);
+    chip8.ram[514] = 0x13;
+    chip8.ram[515] = 0x45;
+    chip8.V[x] = kk+1;
+    chip8.superinstructions = false;
+    cycles = chip8.execute();
+    chip8.superinstructions = true;
+    REQUIRE( chip8.pc == 514 );
+    REQUIRE( cycles == 1 );
+}
+
+// Load the delay timer and loop until it reaches 0.
+TEST_CASE( "Superinstruction - LD Vx, DT + SE Vx, 0 + JP addr" ) {
+    unsigned short x = 0x0002;
+
+    prepare_test(0xF007 | (x << 8));
+    chip8.ram[514] = 0x30 | x;
+    chip8.ram[515] = 0x00;
+    chip8.ram[516] = 0x12;
+    chip8.ram[517] = 0x00;
+    chip8.delay_timer = 3;
+    unsigned int cycles = chip8.execute();
+    REQUIRE( chip8.V[x] == 3 );
+    REQUIRE( chip8.pc == 512 );
+    REQUIRE( cycles == 3 );
+
+    chip8.delay_timer = 0;
+    cycles = chip8.execute();
+    REQUIRE( chip8.V[x] == 0 );
+    REQUIRE( chip8.pc == 518 );
+    REQUIRE( cycles == 2 );
+}
+
+// Set I = nnn and draw the sprite there on the same dispatch.
+TEST_CASE( "Superinstruction - LD I, addr + DRW Vx, Vy, nibble" ) {
+    prepare_test(0xA000 | 0x0005); // font sprite for "1"
+    chip8.ram[514] = 0xD0 | 0x01;
+    chip8.ram[515] = 0x25;
+    chip8.V[1] = 10;
+    chip8.V[2] = 4;
+    memset(chip8.display, 0, sizeof(chip8.display));
+
+    unsigned int cycles = chip8.execute();
+
+    REQUIRE( cycles == 2 );
+    REQUIRE( chip8.pc == 516 );
+    REQUIRE( chip8.I == 5 );
+    REQUIRE( chip8.pixel(12, 4) == 1 );  // 0x20: top of the "1"
+    REQUIRE( chip8.pixel(11, 4) == 0 );
+    REQUIRE( chip8.pixel(13, 8) == 1 );  // 0x70: base of the "1"
+    REQUIRE( chip8.V[0xF] == 0 );
+}
+
+
+// Set Vx = Vx SHR 1, or Vy SHR 1 on the COSMAC VIP.
+TEST_CASE( "8xy6 - SHR Vx {, Vy}" ) {
+    unsigned short x = 0x0003;
+    unsigned short y = 0x0005;
+
+    prepare_test(0x8006 | (x << 8) | (y << 4));
+    chip8.V[x] = 0x05;
+    chip8.V[y] = 0x40;
+    chip8.runStep();
+    REQUIRE( chip8.V[x] == 0x02 );
+    REQUIRE( chip8.V[0xF] == 1 );
+
+    chip8.setQuirks(QUIRKS_COSMAC);
+    prepare_test(0x8006 | (x << 8) | (y << 4));
+    chip8.V[x] = 0x05;
+    chip8.V[y] = 0x40;
+    chip8.runStep();
+    chip8.setQuirks(QUIRKS_CHIP8);
+    REQUIRE( chip8.V[x] == 0x20 );
+    REQUIRE( chip8.V[0xF] == 0 );
+}
+
+// Set Vx = Vx SHL 1, or Vy SHL 1 on the COSMAC VIP.
+TEST_CASE( "8xyE - SHL Vx {, Vy}" ) {
+    unsigned short x = 0x0003;
+    unsigned short y = 0x0005;
+
+    prepare_test(0x800E | (x << 8) | (y << 4));
+    chip8.V[x] = 0x81;
+    chip8.V[y] = 0x01;
+    chip8.runStep();
+    REQUIRE( chip8.V[x] == 0x02 );
+    REQUIRE( chip8.V[0xF] == 1 );
+
+    chip8.setQuirks(QUIRKS_COSMAC);
+    prepare_test(0x800E | (x << 8) | (y << 4));
+    chip8.V[x] = 0x81;
+    chip8.V[y] = 0x01;
+    chip8.runStep();
+    chip8.setQuirks(QUIRKS_CHIP8);
+    REQUIRE( chip8.V[x] == 0x02 );
+    REQUIRE( chip8.V[0xF] == 0 );
+}
+
+// Jump to location nnn + V0, or xnn + Vx on SUPER-CHIP.
+TEST_CASE( "Bnnn - JP V0, addr" ) {
+    prepare_test(0xB234);
+    chip8.V[0] = 0x10;
+    chip8.V[2] = 0x20;
+    chip8.runStep();
+    REQUIRE( chip8.pc == 0x0244 );
+
+    chip8.setQuirks(QUIRKS_SCHIP);
+    prepare_test(0xB234);
+    chip8.V[0] = 0x10;
+    chip8.V[2] = 0x20;
+    chip8.runStep();
+    chip8.setQuirks(QUIRKS_CHIP8);
+    REQUIRE( chip8.pc == 0x0254 );
+}
+
+// Store registers V0 through Vx in memory starting at location I.
+TEST_CASE( "Fx55 - LD [I], Vx" ) {
+    unsigned short x = 0x0002;
+
+    prepare_test(0xF055 | (x << 8));
+    chip8.I = 0x0300;
+    chip8.V[0] = 1;
+    chip8.V[1] = 2;
+    chip8.V[2] = 3;
+    chip8.ram[0x0303] = 0;
+    chip8.runStep();
+    REQUIRE( chip8.ram[0x0300] == 1 );
+    REQUIRE( chip8.ram[0x0301] == 2 );
+    REQUIRE( chip8.ram[0x0302] == 3 );
+    REQUIRE( chip8.ram[0x0303] == 0 );
+    REQUIRE( chip8.I == 0x0300 );
+
+    // the COSMAC VIP leaves I past the last register stored
+    chip8.setQuirks(QUIRKS_COSMAC);
+    prepare_test(0xF055 | (x << 8));
+    chip8.I = 0x0300;
+    chip8.runStep();
+    chip8.setQuirks(QUIRKS_CHIP8);
+    REQUIRE( chip8.I == 0x0303 );
+}
+
+
+// Unknown opcodes and running off the game fault the machine instead of exiting.
+TEST_CASE( "Faults" ) {
+    prepare_test(0xE0FF);
+    unsigned int cycles = chip8.execute();
+    REQUIRE( cycles == 0 );
+    REQUIRE( chip8.fault.active == true );
+    REQUIRE( chip8.fault.pc == 512 );
+    REQUIRE( chip8.fault.opcode == 0xE0FF );
+
+    // a faulted machine does not run anything else
+    chip8.ram[512] = 0x60;
+    cycles = chip8.execute();
+    REQUIRE( cycles == 0 );
+    REQUIRE( chip8.pc == 512 );
+
+    prepare_test(0x6000);
+    REQUIRE( chip8.fault.active == false );
+    chip8.game_max_address = 512;
+    cycles = chip8.execute();
+    REQUIRE( cycles == 0 );
+    REQUIRE( chip8.fault.active == true );
+    REQUIRE( chip8.fault.pc == 512 );
+
+    prepare_test(0x800F);
+    chip8.execute();
+    REQUIRE( chip8.fault.active == true );
+    prepare_test(0xF0FF);
+    chip8.execute();
+    REQUIRE( chip8.fault.active == true );
+    chip8.clearFault();
+}
+
+
+// Hostile games wrap around memory, the stack and the screen instead of
+// reaching outside of them.
+TEST_CASE( "Bounds" ) {
+    // Fx55 past the end of memory wraps to the start
+    prepare_test(0xF255);
+    chip8.I = 0x0FFF;
+    chip8.V[0] = 7;
+    chip8.V[1] = 8;
+    chip8.V[2] = 9;
+    unsigned char font[2] = { chip8.ram[0], chip8.ram[1] };
+    chip8.runStep();
+    REQUIRE( chip8.ram[0x0FFF] == 7 );
+    REQUIRE( chip8.ram[0] == 8 );
+    REQUIRE( chip8.ram[1] == 9 );
+    REQUIRE( chip8.ram[0x1000] == 0 );
+    chip8.ram[0] = font[0];
+    chip8.ram[1] = font[1];
+    chip8.ram[0x0FFF] = 0;
+
+    // key checks only look at the low nibble of Vx
+    prepare_test(0xE19E);
+    chip8.V[1] = 0x13;
+    chip8.keys[3] = 1;
+    chip8.runStep();
+    REQUIRE( chip8.pc == 516 );
+
+    // nested calls past the stack size wrap around it
+    for (int i=0; i<Chip8::STACK_SIZE+4; i++) {
+        prepare_test(0x2200);
+        chip8.stack_pointer = i & Chip8::STACK_MASK;
+        chip8.runStep();
+    }
+    REQUIRE( chip8.stack_pointer == 4 );
+    REQUIRE( chip8.pc == 0x0200 );
+}
+
+// XO-CHIP has 64KB of memory, and wraps at the end of it instead
+TEST_CASE( "Bounds - XO-CHIP" ) {
+    Chip8 xo;
+    unsigned char game[2] = { 0xF2, 0x55 };
+    xo.loadRom(game, sizeof(game), QUIRKS_XOCHIP);
+    REQUIRE( xo.memorySize() == Chip8::RAM_SIZE );
+    xo.I = 0xFFFF;
+    xo.V[0] = 7;
+    xo.V[1] = 8;
+    xo.V[2] = 9;
+    xo.execute();
+    REQUIRE( xo.ram[0xFFFF] == 7 );
+    REQUIRE( xo.ram[0] == 8 );
+    REQUIRE( xo.ram[1] == 9 );
+
+    // a snapshot copies all of it, a classic one only its 4KB
+    Chip8 copy;
+    copy.restore(xo);
+    REQUIRE( copy.ram[0xFFFF] == 7 );
+    REQUIRE( copy.stateHash() == xo.stateHash() );
+    REQUIRE( xo.stateSize() - chip8.stateSize() == Chip8::RAM_SIZE - Chip8::CLASSIC_RAM_SIZE );
+}
+
+// Display n-byte sprite at (Vx, Vy), wrapping around the screen edges.
+TEST_CASE( "Dxyn - DRW Vx, Vy, nibble" ) {
+    prepare_test(0xD125);
+    chip8.I = 0; // font sprite for "0": F0 90 90 90 F0
+    chip8.V[1] = 62;
+    chip8.V[2] = 30;
+    memset(chip8.display, 0, sizeof(chip8.display));
+
+    chip8.runStep();
+
+    REQUIRE( chip8.pixel(62, 30) == 1 );
+    REQUIRE( chip8.pixel(1, 30) == 1 );
+    REQUIRE( chip8.pixel(63, 31) == 0 );
+    REQUIRE( chip8.pixel(62, 0) == 1 );
+    REQUIRE( chip8.pixel(1, 2) == 1 );
+    REQUIRE( chip8.V[0xF] == 0 );
+
+    // drawing it again erases it and reports the collision
+    prepare_test(0xD125);
+    chip8.runStep();
+    REQUIRE( chip8.pixel(62, 30) == 0 );
+    REQUIRE( chip8.V[0xF] == 1 );
+
+    // clipped on SUPER-CHIP
+    chip8.setQuirks(QUIRKS_SCHIP);
+    prepare_test(0xD125);
+    chip8.runStep();
+    chip8.setQuirks(QUIRKS_CHIP8);
+    REQUIRE( chip8.pixel(62, 30) == 1 );
+    REQUIRE( chip8.pixel(1, 30) == 0 );
+    REQUIRE( chip8.pixel(62, 0) == 0 );
+}
+
+
+// Switch between 64x32 and 128x64, clearing the screen.
+TEST_CASE( "00FE/00FF - LOW/HIGH" ) {
+    unsigned char game[] = { 0x00, 0xFF, 0x00, 0xFE };
+    Chip8 schip;
+    schip.loadRom(game, sizeof(game), QUIRKS_SCHIP);
+    schip.setPixel(10, 10, true);
+
+    schip.execute();
+    REQUIRE( schip.hires );
+    REQUIRE( schip.displayWidth() == 128 );
+    REQUIRE( schip.pixel(10, 10) == 0 );
+
+    schip.setPixel(100, 50, true);
+    schip.execute();
+    REQUIRE( !schip.hires );
+    REQUIRE( schip.displayHeight() == 32 );
+    REQUIRE( schip.pixel(100, 50) == 0 );
+
+    // just 0nnn on CHIP-8
+    Chip8 classic;
+    classic.loadRom(game, sizeof(game));
+    classic.execute();
+    REQUIRE( !classic.hires );
+    REQUIRE( classic.pc == 0x202 );
+}
+
+// Scroll down n rows, right or left by 4 pixels.
+TEST_CASE( "00Cn/00FB/00FC - SCD/SCR/SCL" ) {
+    unsigned char game[] = { 0x00, 0xFF, 0x00, 0xC2, 0x00, 0xFB, 0x00, 0xFC, 0x00, 0xFC, 0x00, 0xFE, 0x00, 0xFB };
+    Chip8 schip;
+    schip.loadRom(game, sizeof(game), QUIRKS_SCHIP);
+    schip.execute();
+    schip.setPixel(0, 0, true);
+    schip.setPixel(63, 1, true);
+    schip.setPixel(127, 2, true);
+    schip.rehash();
+
+    schip.execute();
+    REQUIRE( schip.pixel(0, 2) );
+    REQUIRE( schip.pixel(63, 3) );
+    REQUIRE( schip.pixel(127, 4) );
+    REQUIRE( schip.pixel(0, 0) == 0 );
+
+    // across the middle of the row, and off the right edge
+    schip.execute();
+    REQUIRE( schip.pixel(4, 2) );
+    REQUIRE( schip.pixel(67, 3) );
+    REQUIRE( schip.pixel(127, 4) == 0 );
+
+    schip.execute();
+    schip.execute();
+    REQUIRE( schip.pixel(59, 3) );
+    REQUIRE( schip.pixel(0, 2) == 0 );
+
+    Chip8 copy = schip;
+    copy.rehash();
+    REQUIRE( copy.stateHash() == schip.stateHash() );
+
+    // in low resolution, nothing spills past column 63
+    schip.execute();
+    schip.setPixel(62, 0, true);
+    schip.execute();
+    REQUIRE( schip.display[0][0][0] == 0 );
+    REQUIRE( schip.display[0][0][1] == 0 );
+}
+
+// 16x16 sprites, two bytes a row, clipped at the edges on SUPER-CHIP.
+TEST_CASE( "Dxy0 - DRW Vx, Vy, 0" ) {
+    unsigned char game[] = { 0x00, 0xFF, 0xD0, 0x10, 0xD0, 0x10, 0x00, 0xFE, 0xD2, 0x20 };
+    Chip8 schip;
+    schip.loadRom(game, sizeof(game), QUIRKS_SCHIP);
+    schip.I = 0x300;
+    for (int i=0; i<32; i++) {
+        schip.ram[0x300 + i] = 0xFF;
+    }
+    schip.rehash();
+    schip.V[0] = 120;
+    schip.V[1] = 60;
+
+    schip.execute();
+    schip.execute();
+    REQUIRE( schip.pixel(120, 60) );
+    REQUIRE( schip.pixel(127, 63) );
+    REQUIRE( schip.pixel(0, 60) == 0 );
+    REQUIRE( schip.pixel(120, 0) == 0 );
+    REQUIRE( schip.V[0xF] == 0 );
+
+    schip.execute();
+    REQUIRE( schip.pixel(120, 60) == 0 );
+    REQUIRE( schip.V[0xF] == 1 );
+
+    // low resolution too
+    schip.execute();
+    schip.execute();
+    REQUIRE( schip.pixel(0, 0) );
+    REQUIRE( schip.pixel(15, 15) );
+    REQUIRE( schip.pixel(16, 15) == 0 );
+
+    Chip8 copy = schip;
+    copy.rehash();
+    REQUIRE( copy.stateHash() == schip.stateHash() );
+}
+
+// Dxyn against a pixel at a time model of it, on every profile and
+// resolution: the origin wraps around the screen, the pixels past the edges
+// wrap too or are clipped.
+TEST_CASE( "Dxyn - wrapping and clipping" ) {
+    const Chip8Quirks profiles[] = { QUIRKS_CHIP8, QUIRKS_COSMAC, QUIRKS_SCHIP, QUIRKS_XOCHIP };
+    const int xs[] = { 0, 1, 7, 56, 57, 63, 64, 65, 100, 113, 120, 127, 200, 255 };
+    const int ys[] = { 0, 5, 17, 28, 31, 32, 49, 60, 63, 255 };
+    const int heights[] = { 5, 15, 0 };
+    unsigned int state = 1;
+
+    for (Chip8Quirks quirks : profiles) {
+        bool clip = quirks == QUIRKS_COSMAC || quirks == QUIRKS_SCHIP;
+        bool schip = quirks == QUIRKS_SCHIP || quirks == QUIRKS_XOCHIP;
+        for (int hires = 0; hires <= (int)schip; hires++) {
+            for (int n : heights) {
+                if (n == 0 && !schip) {
+                    continue;
+                }
+                unsigned char game[] = { 0xD0, (unsigned char)(0x10 | n) };
+                Chip8 machine;
+                machine.loadRom(game, sizeof(game), quirks);
+                machine.hires = hires;
+                const int width = machine.displayWidth(), height = machine.displayHeight();
+                const int sprite_width = n == 0 ? 16 : 8, sprite_height = n == 0 ? 16 : n;
+
+                for (int x : xs) {
+                    for (int y : ys) {
+                        // a random sprite over a random screen
+                        std::vector<unsigned char> expected(width*height);
+                        for (int i=0; i<width*height; i++) {
+                            state = state*1103515245 + 12345;
+                            expected[i] = (state >> 16) & 1;
+                            machine.setPixel(i % width, i / width, expected[i]);
+                        }
+                        for (int i=0; i<32; i++) {
+                            state = state*1103515245 + 12345;
+                            machine.ram[0x300 + i] = state >> 16;
+                        }
+                        machine.rehash();
+                        machine.pc = 0x200;
+                        machine.I = 0x300;
+                        machine.V[0] = x;
+                        machine.V[1] = y;
+
+                        bool collision = false;
+                        for (int row=0; row<sprite_height; row++) {
+                            for (int col=0; col<sprite_width; col++) {
+                                int bit = n == 0 ? ((machine.ram[0x300 + 2*row] << 8 | machine.ram[0x301 + 2*row]) >> (15 - col)) & 1
+                                                 : (machine.ram[0x300 + row] >> (7 - col)) & 1;
+                                int px = x % width + col, py = y % height + row;
+                                if (!bit || (clip && (px >= width || py >= height))) {
+                                    continue;
+                                }
+                                px %= width;
+                                py %= height;
+                                collision |= expected[py*width + px];
+                                expected[py*width + px] ^= 1;
+                            }
+                        }
+
+                        machine.execute();
+                        int wrong = 0;
+                        for (int i=0; i<width*height; i++) {
+                            wrong += machine.pixel(i % width, i / width) != expected[i];
+                        }
+                        CAPTURE( quirks, hires, n, x, y );
+                        REQUIRE( wrong == 0 );
+                        REQUIRE( machine.V[0xF] == collision );
+                        unsigned long long hash = machine.stateHash();
+                        machine.rehash();
+                        REQUIRE( machine.stateHash() == hash );
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Point I to the big digit sprite for Vx, save and restore V0 to Vx in the
+// RPL flags.
+TEST_CASE( "Fx30/Fx75/Fx85 - LD HF, Vx / LD R, Vx / LD Vx, R" ) {
+    unsigned char game[] = { 0xF0, 0x30, 0xF3, 0x75, 0xF3, 0x85 };
+    Chip8 schip;
+    schip.loadRom(game, sizeof(game), QUIRKS_SCHIP);
+    schip.V[0] = 7;
+    schip.V[1] = 11;
+    schip.V[3] = 33;
+    schip.V[4] = 44;
+
+    schip.execute();
+    REQUIRE( schip.ram[schip.I] == 0xFF ); // top of the big 7
+    REQUIRE( schip.ram[schip.I + 9] == 0x60 );
+
+    schip.execute();
+    memset(schip.V, 0, sizeof(schip.V));
+    schip.execute();
+    REQUIRE( schip.V[0] == 7 );
+    REQUIRE( schip.V[1] == 11 );
+    REQUIRE( schip.V[3] == 33 );
+    REQUIRE( schip.V[4] == 0 );
+
+    Chip8 classic;
+    classic.loadRom(game, sizeof(game));
+    classic.execute();
+    REQUIRE( classic.fault.active );
+}
+
+// Stop the interpreter.
+TEST_CASE( "00FD - EXIT" ) {
+    unsigned char game[] = { 0x00, 0xFD };
+    Chip8 schip;
+    schip.loadRom(game, sizeof(game), QUIRKS_SCHIP);
+    REQUIRE( schip.execute() == 0 );
+    REQUIRE( schip.fault.active );
+    REQUIRE( schip.fault.opcode == 0x00FD );
+}
+
+
+// Point I anywhere in 64KB, with the address in the next word. Skips jump
+// over all 4 bytes of it.
+TEST_CASE( "F000 nnnn - LD I, long addr" ) {
+    unsigned char game[] = { 0xF0, 0x00, 0x12, 0x34, 0x30, 0x00, 0xF0, 0x00, 0xFF, 0xFF, 0x60, 0x01 };
+    Chip8 xochip;
+    xochip.loadRom(game, sizeof(game), QUIRKS_XOCHIP);
+
+    xochip.execute();
+    REQUIRE( xochip.I == 0x1234 );
+    REQUIRE( xochip.pc == 0x204 );
+
+    xochip.execute();
+    REQUIRE( xochip.pc == 0x20A );
+    xochip.execute();
+    REQUIRE( xochip.V[0] == 1 );
+    REQUIRE( xochip.I == 0x1234 );
+
+    Chip8 schip;
+    schip.loadRom(game, sizeof(game), QUIRKS_SCHIP);
+    schip.execute();
+    REQUIRE( schip.fault.active );
+}
+
+// Select the planes drawn and cleared. Each plane drawn takes its own
+// sprite, one after the other.
+TEST_CASE( "Fn01 - PLANE n" ) {
+    unsigned char game[] = { 0xF3, 0x01, 0xD0, 0x01, 0xF2, 0x01, 0xD0, 0x01, 0x00, 0xE0, 0xF0, 0x01, 0x00, 0xE0 };
+    Chip8 xochip;
+    xochip.loadRom(game, sizeof(game), QUIRKS_XOCHIP);
+    xochip.I = 0x300;
+    xochip.ram[0x300] = 0xFF;
+    xochip.ram[0x301] = 0x0F;
+    xochip.rehash();
+
+    xochip.execute();
+    REQUIRE( xochip.planes == 3 );
+    xochip.execute();
+    REQUIRE( xochip.pixel(0, 0) == 1 );
+    REQUIRE( xochip.pixel(4, 0) == 3 );
+    REQUIRE( xochip.pixel(8, 0) == 0 );
+    REQUIRE( xochip.V[0xF] == 0 );
+
+    // the second plane alone, with the first sprite
+    xochip.execute();
+    xochip.execute();
+    REQUIRE( xochip.pixel(0, 0) == 3 );
+    REQUIRE( xochip.pixel(4, 0) == 1 );
+    REQUIRE( xochip.V[0xF] == 1 );
+
+    Chip8 copy = xochip;
+    copy.rehash();
+    REQUIRE( copy.stateHash() == xochip.stateHash() );
+
+    xochip.execute();
+    REQUIRE( xochip.pixel(0, 0) == 1 );
+    REQUIRE( xochip.pixel(4, 0) == 1 );
+    copy = xochip;
+    copy.rehash();
+    REQUIRE( copy.stateHash() == xochip.stateHash() );
+
+    // no planes, nothing cleared
+    xochip.execute();
+    xochip.execute();
+    REQUIRE( xochip.pixel(0, 0) == 1 );
+}
+
+// Scroll the selected planes up.
+TEST_CASE( "00Dn - SCU nibble" ) {
+    unsigned char game[] = { 0x00, 0xD3, 0xF2, 0x01, 0x00, 0xD1 };
+    Chip8 xochip;
+    xochip.loadRom(game, sizeof(game), QUIRKS_XOCHIP);
+    xochip.setPixel(5, 10, true);
+    xochip.setPixel(6, 10, true, 1);
+    xochip.rehash();
+
+    xochip.execute();
+    REQUIRE( xochip.pixel(5, 7) == 1 );
+    REQUIRE( xochip.pixel(6, 10) == 2 );
+
+    xochip.execute();
+    xochip.execute();
+    REQUIRE( xochip.pixel(5, 7) == 1 );
+    REQUIRE( xochip.pixel(6, 9) == 2 );
+    REQUIRE( xochip.pixel(6, 10) == 0 );
+
+    Chip8 copy = xochip;
+    copy.rehash();
+    REQUIRE( copy.stateHash() == xochip.stateHash() );
+}
+
+// Save and load a range of registers at I, in either order, leaving I alone.
+TEST_CASE( "5xy2/5xy3 - LD [I], Vx-Vy / LD Vx-Vy, [I]" ) {
+    unsigned char game[] = { 0x51, 0x32, 0x53, 0x12, 0x54, 0x63, 0x51, 0x22 };
+    Chip8 xochip;
+    xochip.loadRom(game, sizeof(game), QUIRKS_XOCHIP);
+    xochip.I = 0x400;
+    xochip.V[1] = 1;
+    xochip.V[2] = 2;
+    xochip.V[3] = 3;
+
+    xochip.execute();
+    REQUIRE( xochip.ram[0x400] == 1 );
+    REQUIRE( xochip.ram[0x402] == 3 );
+    REQUIRE( xochip.I == 0x400 );
+
+    xochip.execute();
+    REQUIRE( xochip.ram[0x400] == 3 );
+    REQUIRE( xochip.ram[0x401] == 2 );
+    REQUIRE( xochip.ram[0x402] == 1 );
+
+    xochip.execute();
+    REQUIRE( xochip.V[4] == 3 );
+    REQUIRE( xochip.V[5] == 2 );
+    REQUIRE( xochip.V[6] == 1 );
+    REQUIRE( xochip.I == 0x400 );
+
+    Chip8 copy = xochip;
+    copy.rehash();
+    REQUIRE( copy.stateHash() == xochip.stateHash() );
+
+    // just 5xy0 elsewhere
+    Chip8 classic;
+    classic.loadRom(game, sizeof(game));
+    classic.V[1] = 1;
+    classic.V[3] = 1;
+    classic.execute();
+    REQUIRE( classic.pc == 0x204 );
+}
+
+// Load the audio pattern from I and set its pitch.
+TEST_CASE( "F002/Fx3A - AUDIO / PITCH Vx" ) {
+    unsigned char game[] = { 0xF0, 0x02, 0xF1, 0x3A };
+    Chip8 xochip;
+    xochip.loadRom(game, sizeof(game), QUIRKS_XOCHIP);
+    REQUIRE( xochip.audioRate() == 4000.0f );
+    xochip.I = 0x400;
+    for (int i=0; i<16; i++) {
+        xochip.ram[0x400 + i] = i;
+    }
+    xochip.V[1] = 112;
+
+    xochip.execute();
+    REQUIRE( xochip.audio_pattern[15] == 15 );
+    unsigned long long before = xochip.stateHash();
+    xochip.execute();
+    REQUIRE( xochip.pitch == 112 );
+    REQUIRE( xochip.audioRate() == Approx(8000.0f) );
+    REQUIRE( xochip.stateHash() != before );
+}
+
+
+// Run a frame worth of instructions without looking at the clock.
+TEST_CASE( "runFrame" ) {
+    Chip8 fresh;
+    unsigned char game[2] = { 0x12, 0x00 }; // JP 200
+    fresh.loadRom(game, sizeof(game));
+    fresh.delay_timer = 10;
+
+    // 500Hz doesn't divide by 60, so frames run 8 or 9 instructions, adding up
+    // to exactly 500 a second
+    for (int i=0; i<60; i++) {
+        fresh.runFrame();
+    }
+    REQUIRE( fresh.delay_timer == 0 );
+    REQUIRE( fresh.cycle_credit == 0 );
+}
+
+// One bit per pixel, msb first.
+TEST_CASE( "packDisplay" ) {
+    Chip8 fresh;
+    unsigned char packed[Chip8::PACKED_DISPLAY_SIZE];
+    fresh.setPixel(0, 0, true);
+    fresh.setPixel(9, 0, true);
+    fresh.setPixel(63, 31, true);
+
+    fresh.packDisplay(packed);
+
+    REQUIRE( packed[0] == 0x80 );
+    REQUIRE( packed[1] == 0x40 );
+    REQUIRE( packed[2] == 0x00 );
+    REQUIRE( packed[Chip8::PACKED_DISPLAY_SIZE-1] == 0x01 );
+}
+
+
+// Fingerprint of the machine state, restored along with a copy of it.
+TEST_CASE( "stateHash" ) {
+    Chip8 a;
+    unsigned char game[4] = { 0xC0, 0xFF, 0x12, 0x00 }; // RND V0, FF; JP 200
+    a.loadRom(game, sizeof(game));
+    Chip8 snapshot = a;
+    REQUIRE( a.stateHash() == snapshot.stateHash() );
+
+    a.runFrame();
+    unsigned long long after_frame = a.stateHash();
+    REQUIRE( after_frame != snapshot.stateHash() );
+
+    // keys are input, not state
+    a.keys[3] = 1;
+    REQUIRE( a.stateHash() == after_frame );
+
+    // direct writes need a rehash
+    a.ram[0x0F00] ^= 1;
+    a.rehash();
+    REQUIRE( a.stateHash() != after_frame );
+    a.ram[0x0F00] ^= 1;
+    a.rehash();
+    REQUIRE( a.stateHash() == after_frame );
+
+    // restoring the snapshot replays the same frame
+    a = snapshot;
+    a.runFrame();
+    REQUIRE( a.stateHash() == after_frame );
+}
+
+
+// The incremental hash matches one computed from scratch.
+TEST_CASE( "stateHash - incremental" ) {
+    // draws, stores BCD and registers all over memory, and clears the screen
+    unsigned char game[] = {
+        0xC0, 0xFF, // 200: RND V0, FF
+        0xC1, 0x3F, // 202: RND V1, 3F
+        0xF0, 0x29, // 204: LD F, V0
+        0xD1, 0x05, // 206: DRW V1, V0, 5
+        0xA6, 0x00, // 208: LD I, 600
+        0xF1, 0x1E, // 20A: ADD I, V1
+        0xF0, 0x33, // 20C: LD B, V0
+        0xF5, 0x55, // 20E: LD [I], V5
+        0x32, 0x50, // 210: SE V2, 50
+        0x12, 0x1A, // 212: JP 21A
+        0x00, 0xE0, // 214: CLS
+        0x62, 0x00, // 216: LD V2, 0
+        0x12, 0x00, // 218: JP 200
+        0x72, 0x01, // 21A: ADD V2, 1
+        0x12, 0x00, // 21C: JP 200
+    };
+    Chip8 a;
+    a.loadRom(game, sizeof(game));
+
+    for (int frame=0; frame<200; frame++) {
+        a.runFrame();
+        Chip8 b = a;
+        b.rehash();
+        REQUIRE( a.stateHash() == b.stateHash() );
+    }
+}
+
+
+// Memory writes are stamped with the frame that made them.
+TEST_CASE( "write_frames" ) {
+    unsigned char game[] = {
+        0xA3, 0x00, // 200: LD I, 300
+        0xF1, 0x55, // 202: LD [I], V1
+        0x12, 0x04, // 204: JP 204
+    };
+    unsigned int write_frames[Chip8::RAM_SIZE] = {};
+    Chip8 chip8;
+    chip8.loadRom(game, sizeof(game));
+    chip8.runFrame();
+    REQUIRE( chip8.frames == 1 );
+
+    // Fx55 stamps the frame it ran in, plus one so zero means never written
+    chip8.write_frames = write_frames;
+    chip8.pc = 0x200;
+    chip8.runFrame();
+    REQUIRE( chip8.frames == 2 );
+    REQUIRE( write_frames[0x300] == 2 );
+    REQUIRE( write_frames[0x301] == 2 );
+    REQUIRE( write_frames[0x302] == 0 );
+    REQUIRE( write_frames[0x200] == 0 );
+}
+
+// Breakpoints stop before the instruction, resume runs it.
+TEST_CASE( "Debugger - breakpoints" ) {
+    unsigned char game[] = {
+        0x60, 0x01, // 200: LD V0, 1
+        0x61, 0x02, // 202: LD V1, 2
+        0x70, 0x01, // 204: ADD V0, 1
+        0x12, 0x04, // 206: JP 204
+    };
+    Chip8 a;
+    a.loadRom(game, sizeof(game));
+    unsigned char flags[Chip8::RAM_SIZE] = {};
+    a.debug_flags = flags;
+
+    // no flags: the plain execute, with 6xkk + 6xkk fused
+    REQUIRE( a.execute() == 2 );
+    REQUIRE( a.pc == 0x204 );
+
+    a.setDebugFlags(0x206, DEBUG_BREAK);
+    REQUIRE( a.execute() == 1 );
+    REQUIRE( a.execute() == 0 );
+    REQUIRE( a.debug_break.active );
+    REQUIRE( a.debug_break.pc == 0x206 );
+    REQUIRE( a.debug_break.reason == DEBUG_BREAK );
+    REQUIRE( a.execute() == 0 ); // stays stopped until resumed
+    REQUIRE( a.pc == 0x206 );
+
+    a.resume();
+    REQUIRE( a.execute() == 1 );
+    REQUIRE( a.pc == 0x204 );
+    REQUIRE( a.V[0] == 2 );
+
+    // a frame stops at the breakpoint
+    a.runFrame();
+    REQUIRE( a.debug_break.active );
+    REQUIRE( a.pc == 0x206 );
+    REQUIRE( a.V[0] == 3 );
+
+    // step runs one instruction, breakpoint or not
+    REQUIRE( a.step() == 1 );
+    REQUIRE( a.pc == 0x204 );
+    REQUIRE_FALSE( a.debug_break.active );
+
+    a.setDebugFlags(0x206, 0);
+    REQUIRE( a.debug_flag_count == 0 );
+    a.runFrame();
+    REQUIRE_FALSE( a.debug_break.active );
+}
+
+
+// A frame cut short by a breakpoint doesn't tick, and resuming finishes it.
+TEST_CASE( "Debugger - breakpoints keep the frame's credit" ) {
+    unsigned char game[] = {
+        0x60, 0x10, // 200: LD V0, 10
+        0xF0, 0x15, // 202: LD DT, V0
+        0x71, 0x01, // 204: ADD V1, 1
+        0x12, 0x04, // 206: JP 204
+    };
+    unsigned char flags_a[Chip8::RAM_SIZE] = {};
+    unsigned char flags_b[Chip8::RAM_SIZE] = {};
+    Chip8 a, b;
+    a.loadRom(game, sizeof(game));
+    b.loadRom(game, sizeof(game));
+    a.debug_flags = flags_a;
+    b.debug_flags = flags_b;
+    a.setDebugFlags(0x300, DEBUG_BREAK); // never hit, but runs the same path
+    b.setDebugFlags(0x206, DEBUG_BREAK);
+
+    b.runFrame();
+    REQUIRE( b.debug_break.active );
+    REQUIRE( b.frames == 0 );
+    REQUIRE( b.delay_timer == 0x10 );
+
+    b.setDebugFlags(0x206, 0);
+    b.resume();
+    a.runFrame();
+    b.runFrame();
+    REQUIRE( b.frames == 1 );
+    REQUIRE( b.delay_timer == a.delay_timer );
+    REQUIRE( b.instructions == a.instructions );
+    REQUIRE( b.cycle_credit == a.cycle_credit );
+    REQUIRE( b.V[1] == a.V[1] );
+}
+
+// Watches stop on memory accesses made by Fx33/Fx55/Fx65 and Dxyn.
+TEST_CASE( "Debugger - watchpoints" ) {
+    unsigned char game[] = {
+        0xA3, 0x00, // 200: LD I, 300
+        0xF2, 0x65, // 202: LD V2, [I]
+        0xF0, 0x33, // 204: LD B, V0
+        0xD0, 0x05, // 206: DRW V0, V0, 5
+        0x12, 0x06, // 208: JP 206
+    };
+    Chip8 a;
+    a.loadRom(game, sizeof(game));
+    unsigned char flags[Chip8::RAM_SIZE] = {};
+    a.debug_flags = flags;
+    a.setDebugFlags(0x302, DEBUG_READ);
+    a.setDebugFlags(0x301, DEBUG_WRITE);
+
+    a.runFrame();
+    REQUIRE( a.debug_break.active );
+    REQUIRE( a.debug_break.pc == 0x202 );
+    REQUIRE( a.debug_break.address == 0x302 );
+    REQUIRE( a.debug_break.reason == DEBUG_READ );
+
+    a.resume();
+    a.runFrame();
+    REQUIRE( a.debug_break.pc == 0x204 );
+    REQUIRE( a.debug_break.address == 0x301 );
+    REQUIRE( a.debug_break.reason == DEBUG_WRITE );
+
+    a.resume();
+    a.runFrame();
+    REQUIRE( a.debug_break.pc == 0x206 );
+    REQUIRE( a.debug_break.reason == DEBUG_READ );
+}
+
+
+// Run to cursor stops once, then the cursor is gone.
+TEST_CASE( "Debugger - run to cursor" ) {
+    unsigned char game[] = {
+        0x70, 0x01, // 200: ADD V0, 1
+        0x12, 0x00, // 202: JP 200
+    };
+    Chip8 a;
+    a.loadRom(game, sizeof(game));
+    unsigned char flags[Chip8::RAM_SIZE] = {};
+    a.debug_flags = flags;
+    a.setDebugFlags(0x202, DEBUG_CURSOR);
+
+    a.runFrame();
+    REQUIRE( a.debug_break.active );
+    REQUIRE( a.debug_break.reason == DEBUG_CURSOR );
+    REQUIRE( a.debug_flag_count == 0 );
+    REQUIRE( a.V[0] == 1 );
+
+    a.resume();
+    a.runFrame();
+    REQUIRE_FALSE( a.debug_break.active );
+}
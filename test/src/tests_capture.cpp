@@ -0,0 +1,296 @@
+#include <stdio.h>
+#include <fstream>
+#include <iterator>
+#include <vector>
+#include "chip8_capture.h"
+#include "catch2/catch.hpp"
+
+
+// Just enough of a GIF decoder for what Chip8Capture writes: the global
+// palette, a graphic control extension before each image, no local palettes
+// and no interlacing. Keeps the canvas after every image.
+struct Gif {
+    int width, height;
+    std::vector<unsigned char> canvas;
+    std::vector<std::vector<unsigned char> > frames;
+    std::vector<int> delays;
+};
+
+static bool decodeLzw(const std::vector<unsigned char>& data, int min_code_size, std::vector<unsigned char>& pixels) {
+    const int clear = 1 << min_code_size, end = clear + 1;
+    std::vector<std::vector<unsigned char> > table;
+    int code_size = 0, previous = -1;
+    size_t bit = 0;
+    for (;;) {
+        if (table.empty()) {
+            for (int i=0; i<clear + 2; i++) {
+                table.push_back(std::vector<unsigned char>(i < clear ? 1 : 0, i));
+            }
+            code_size = min_code_size + 1;
+            previous = -1;
+        }
+        if (bit + code_size > data.size() * 8) {
+            return false;
+        }
+        int code = 0;
+        for (int i=0; i<code_size; i++, bit++) {
+            code |= ((data[bit / 8] >> (bit % 8)) & 1) << i;
+        }
+        if (code == clear) {
+            table.clear();
+            continue;
+        }
+        if (code == end) {
+            return true;
+        }
+        std::vector<unsigned char> entry;
+        if (code < (int)table.size()) {
+            entry = table[code];
+        } else if (code == (int)table.size() && previous >= 0) {
+            entry = table[previous];
+            entry.push_back(table[previous][0]);
+        } else {
+            return false;
+        }
+        pixels.insert(pixels.end(), entry.begin(), entry.end());
+        if (previous >= 0 && table.size() < 4096) {
+            std::vector<unsigned char> added = table[previous];
+            added.push_back(entry[0]);
+            table.push_back(added);
+            if (table.size() == (1u << code_size) && code_size < 12) {
+                code_size++;
+            }
+        }
+        previous = code;
+    }
+}
+
+static bool decodeGif(const char* path, Gif& gif) {
+    std::ifstream fin(path, std::ios::binary);
+    std::vector<unsigned char> data((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+    if (data.size() < 13 + 12 || memcmp(data.data(), "GIF89a", 6) != 0 || data[10] != 0x91) {
+        return false;
+    }
+    gif.width = data[6] | data[7] << 8;
+    gif.height = data[8] | data[9] << 8;
+    gif.canvas.assign(gif.width * gif.height, 0);
+
+    size_t p = 13 + 12;
+    int delay = 0;
+    while (p < data.size()) {
+        unsigned char kind = data[p++];
+        if (kind == 0x3B) {
+            return true;
+        } else if (kind == 0x21) {
+            if (data[p] == 0xF9) {
+                delay = data[p + 3] | data[p + 4] << 8;
+            }
+            p++;
+            while (data[p]) {
+                p += data[p] + 1;
+            }
+            p++;
+        } else if (kind == 0x2C) {
+            int left = data[p] | data[p + 1] << 8, top = data[p + 2] | data[p + 3] << 8;
+            int width = data[p + 4] | data[p + 5] << 8, height = data[p + 6] | data[p + 7] << 8;
+            int min_code_size = data[p + 9];
+            p += 10;
+            std::vector<unsigned char> lzw;
+            while (data[p]) {
+                lzw.insert(lzw.end(), &data[p + 1], &data[p + 1 + data[p]]);
+                p += data[p] + 1;
+            }
+            p++;
+
+            std::vector<unsigned char> pixels;
+            if (!decodeLzw(lzw, min_code_size, pixels) || (int)pixels.size() != width * height) {
+                return false;
+            }
+            for (int y=0; y<height; y++) {
+                for (int x=0; x<width; x++) {
+                    gif.canvas[(top + y) * gif.width + left + x] = pixels[y * width + x];
+                }
+            }
+            gif.frames.push_back(gif.canvas);
+            gif.delays.push_back(delay);
+        } else {
+            return false;
+        }
+    }
+    return false;
+}
+
+// scale is output pixels per 128x64 pixel, low resolution is doubled on top
+static bool canvasShows(const Gif& gif, const std::vector<unsigned char>& canvas, const Chip8& machine, int scale) {
+    if (!machine.hires) {
+        scale *= 2;
+    }
+    for (int y=0; y<gif.height; y++) {
+        for (int x=0; x<gif.width; x++) {
+            if (canvas[y * gif.width + x] != machine.pixel(x / scale, y / scale)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+
+TEST_CASE( "Capture - screens and their timing" ) {
+    const char* path = "capture_test.gif";
+    Chip8 machine;
+    machine.setPixel(0, 3, true);
+
+    // the pixel moves right every 6 frames
+    Chip8Capture capture;
+    REQUIRE( capture.start(path, machine, 2) );
+    std::vector<Chip8> screens(1, machine);
+    for (int f=1; f<=60; f++) {
+        if (f % 6 == 0) {
+            machine.setPixel(f/6 - 1, 3, false);
+            machine.setPixel(f/6, 3, true);
+            screens.push_back(machine);
+        }
+        capture.frame(machine);
+    }
+    capture.stop();
+    REQUIRE( capture.frames == 60 );
+    REQUIRE( capture.dropped == 0 );
+
+    Gif gif;
+    REQUIRE( decodeGif(path, gif) );
+    remove(path);
+    REQUIRE( gif.width == 256 );
+    REQUIRE( gif.height == 128 );
+    REQUIRE( gif.frames.size() == 11 );
+    for (size_t i=0; i<gif.frames.size(); i++) {
+        REQUIRE( canvasShows(gif, gif.frames[i], screens[i], 2) );
+        // 6 frames are a tenth of a second, the last screen gets the minimum
+        REQUIRE( gif.delays[i] == (i < 10 ? 10 : Chip8Capture::MIN_DELAY) );
+    }
+}
+
+TEST_CASE( "Capture - XO-CHIP planes" ) {
+    const char* path = "capture_test.gif";
+    Chip8 machine;
+    machine.hires = true;
+    machine.setPixel(3, 3, true);
+    machine.setPixel(4, 3, true, 1);
+    machine.setPixel(5, 3, true);
+    machine.setPixel(5, 3, true, 1);
+
+    Chip8Capture capture;
+    REQUIRE( capture.start(path, machine, 1) );
+    machine.setPixel(100, 60, true, 1);
+    capture.frame(machine);
+    capture.stop();
+
+    Gif gif;
+    REQUIRE( decodeGif(path, gif) );
+    remove(path);
+    REQUIRE( gif.frames.size() == 2 );
+    REQUIRE( gif.canvas[3*128 + 4] == 2 );
+    REQUIRE( gif.canvas[3*128 + 5] == 3 );
+    REQUIRE( canvasShows(gif, gif.canvas, machine, 1) );
+}
+
+TEST_CASE( "Capture - LZW dictionary resets" ) {
+    const char* path = "capture_test.gif";
+    Chip8 machine;
+    unsigned int state = 1;
+    for (int i=0; i<32; i++) {
+        for (int j=0; j<64; j++) {
+            state = state * 1103515245 + 12345;
+            machine.setPixel(j, i, (state >> 16) & 1);
+        }
+    }
+
+    // noise at 4x is 131072 pixels, well past a 4096 code dictionary
+    Chip8Capture capture;
+    REQUIRE( capture.start(path, machine, 4) );
+    capture.stop();
+
+    Gif gif;
+    REQUIRE( decodeGif(path, gif) );
+    remove(path);
+    REQUIRE( gif.frames.size() == 1 );
+    REQUIRE( canvasShows(gif, gif.canvas, machine, 4) );
+}
+
+TEST_CASE( "Capture - screens that don't last are skipped" ) {
+    const char* path = "capture_test.gif";
+    Chip8 machine;
+
+    // a frame is 1.67 hundredths of a second, under the minimum delay, so a
+    // screen that changes every frame only makes it in every other frame
+    Chip8Capture capture;
+    REQUIRE( capture.start(path, machine, 1) );
+    for (int f=1; f<=60; f++) {
+        machine.setPixel(f, 0, true);
+        capture.frame(machine);
+    }
+    capture.stop();
+
+    Gif gif;
+    REQUIRE( decodeGif(path, gif) );
+    remove(path);
+    int total = 0;
+    for (size_t i=0; i<gif.delays.size(); i++) {
+        REQUIRE( gif.delays[i] >= Chip8Capture::MIN_DELAY );
+        total += gif.delays[i];
+    }
+    REQUIRE( gif.frames.size() < 60 );
+    REQUIRE( total == 100 + Chip8Capture::MIN_DELAY );
+    REQUIRE( canvasShows(gif, gif.canvas, machine, 1) );
+}
+
+TEST_CASE( "Capture - lossless keeps every screen" ) {
+    const char* path = "capture_test.gif";
+    Chip8 machine;
+
+    // full screens of noise every 2 frames, more than the queue holds and
+    // faster than they encode
+    Chip8Capture capture;
+    capture.lossless = true;
+    REQUIRE( capture.start(path, machine, 1) );
+    unsigned int state = 1;
+    for (int f=1; f<=1600; f++) {
+        if (f % 2 == 0) {
+            for (int i=0; i<32; i++) {
+                for (int j=0; j<64; j++) {
+                    state = state * 1103515245 + 12345;
+                    machine.setPixel(j, i, (state >> 16) & 1);
+                }
+            }
+        }
+        capture.frame(machine);
+    }
+    capture.stop();
+    REQUIRE( capture.dropped == 0 );
+
+    Gif gif;
+    REQUIRE( decodeGif(path, gif) );
+    remove(path);
+    REQUIRE( gif.frames.size() == 801 );
+    REQUIRE( canvasShows(gif, gif.canvas, machine, 1) );
+}
+
+TEST_CASE( "Capture - queued screens only hold what changed" ) {
+    // not started, so nothing takes screens off the queue
+    Chip8Capture capture;
+    memset(capture.queued, 0, sizeof(capture.queued));
+    unsigned char packed[CAPTURE_SCREEN_SIZE] = {};
+    packed[10] = 0x80;
+    capture.push(packed, false);
+    REQUIRE( capture.queue.back().delta.size() == Chip8CaptureFrame::RUN_HEADER + 1 );
+
+    // changes far apart take a run each, close ones share one
+    packed[1000] = 0x01;
+    packed[1003] = 0x01;
+    packed[2047] = 0x01;
+    capture.push(packed, false);
+    REQUIRE( capture.queue.back().delta.size() == 2*Chip8CaptureFrame::RUN_HEADER + 4 + 1 );
+
+    capture.push(packed, false);
+    REQUIRE( capture.queue.back().delta.empty() );
+}
@@ -0,0 +1,106 @@
+#include <string.h>
+#include <string>
+#include "chip8_disasm.h"
+#include "catch2/catch.hpp"
+
+
+static std::string decoded(unsigned short opcode, unsigned short next = 0) {
+    char text[Chip8Disassembly::LINE_SIZE];
+    Chip8Disassembly::decode(opcode, text, sizeof(text), next);
+    return text;
+}
+
+
+TEST_CASE( "Disassembly - mnemonics" ) {
+    REQUIRE( decoded(0x00E0) == "CLS" );
+    REQUIRE( decoded(0x00EE) == "RET" );
+    REQUIRE( decoded(0x0123) == "SYS 123" );
+    REQUIRE( decoded(0x1ABC) == "JP ABC" );
+    REQUIRE( decoded(0x2300) == "CALL 300" );
+    REQUIRE( decoded(0x3A42) == "SE VA, 42" );
+    REQUIRE( decoded(0x4A42) == "SNE VA, 42" );
+    REQUIRE( decoded(0x5120) == "SE V1, V2" );
+    REQUIRE( decoded(0x6F00) == "LD VF, 00" );
+    REQUIRE( decoded(0x7101) == "ADD V1, 01" );
+    REQUIRE( decoded(0x8120) == "LD V1, V2" );
+    REQUIRE( decoded(0x8125) == "SUB V1, V2" );
+    REQUIRE( decoded(0x8126) == "SHR V1 {, V2}" );
+    REQUIRE( decoded(0x8127) == "SUBN V1, V2" );
+    REQUIRE( decoded(0x812E) == "SHL V1 {, V2}" );
+    REQUIRE( decoded(0x9120) == "SNE V1, V2" );
+    REQUIRE( decoded(0xA300) == "LD I, 300" );
+    REQUIRE( decoded(0xB300) == "JP V0, 300" );
+    REQUIRE( decoded(0xC0FF) == "RND V0, FF" );
+    REQUIRE( decoded(0xD125) == "DRW V1, V2, 5" );
+    REQUIRE( decoded(0xE59E) == "SKP V5" );
+    REQUIRE( decoded(0xE5A1) == "SKNP V5" );
+    REQUIRE( decoded(0xF507) == "LD V5, DT" );
+    REQUIRE( decoded(0xF50A) == "LD V5, K" );
+    REQUIRE( decoded(0xF515) == "LD DT, V5" );
+    REQUIRE( decoded(0xF518) == "LD ST, V5" );
+    REQUIRE( decoded(0xF51E) == "ADD I, V5" );
+    REQUIRE( decoded(0xF529) == "LD F, V5" );
+    REQUIRE( decoded(0xF533) == "LD B, V5" );
+    REQUIRE( decoded(0xF555) == "LD [I], V5" );
+    REQUIRE( decoded(0xF565) == "LD V5, [I]" );
+
+    // SUPER-CHIP
+    REQUIRE( decoded(0x00C4) == "SCD 4" );
+    REQUIRE( decoded(0x00FB) == "SCR" );
+    REQUIRE( decoded(0x00FC) == "SCL" );
+    REQUIRE( decoded(0x00FD) == "EXIT" );
+    REQUIRE( decoded(0x00FE) == "LOW" );
+    REQUIRE( decoded(0x00FF) == "HIGH" );
+    REQUIRE( decoded(0xF530) == "LD HF, V5" );
+    REQUIRE( decoded(0xF575) == "LD R, V5" );
+    REQUIRE( decoded(0xF585) == "LD V5, R" );
+
+    // XO-CHIP
+    REQUIRE( decoded(0x00D4) == "SCU 4" );
+    REQUIRE( decoded(0x5122) == "LD [I], V1-V2" );
+    REQUIRE( decoded(0x5213) == "LD V2-V1, [I]" );
+    REQUIRE( decoded(0xF000, 0x1234) == "LD I, 1234" );
+    REQUIRE( decoded(0xF201) == "PLANE 2" );
+    REQUIRE( decoded(0xF002) == "AUDIO" );
+    REQUIRE( decoded(0xF53A) == "PITCH V5" );
+
+    // not instructions
+    REQUIRE( decoded(0x5121) == "DW 5121" );
+    REQUIRE( decoded(0x8128) == "DW 8128" );
+    REQUIRE( decoded(0xE500) == "DW E500" );
+    REQUIRE( decoded(0xF5FF) == "DW F5FF" );
+}
+
+TEST_CASE( "Disassembly - cached lines follow memory writes" ) {
+    unsigned char game[] = {
+        0xA2, 0x08, // 200: LD I, 208
+        0xF1, 0x55, // 202: LD [I], V1
+        0x12, 0x04, // 204: JP 204
+        0x00, 0x00, // 206
+        0x00, 0xE0, // 208: CLS
+    };
+    Chip8 chip8;
+    chip8.loadRom(game, sizeof(game));
+    chip8.V[0] = 0x12;
+    chip8.V[1] = 0x08;
+
+    Chip8Disassembly disassembly;
+    const char* line = disassembly.line(chip8, 0x208);
+    REQUIRE( strcmp(line, "CLS") == 0 );
+    REQUIRE( disassembly.line(chip8, 0x208) == line );
+
+    // the game writes JP 208 over it
+    chip8.runFrame();
+    REQUIRE( strcmp(disassembly.line(chip8, 0x208), "JP 208") == 0 );
+    REQUIRE( strcmp(disassembly.line(chip8, 0x207), "SYS 012") == 0 );
+
+    // the last address wraps around to the first for its second byte
+    REQUIRE( strcmp(disassembly.line(chip8, 0xFFFF), "SYS 0F0") == 0 );
+
+    // F000 takes the address after it, and is redone when that changes
+    chip8.ram[0x300] = 0xF0;
+    chip8.ram[0x302] = 0x12;
+    REQUIRE( strcmp(disassembly.line(chip8, 0x300), "LD I, 1200") == 0 );
+    chip8.ram[0x303] = 0x34;
+    REQUIRE( strcmp(disassembly.line(chip8, 0x300), "LD I, 1234") == 0 );
+}
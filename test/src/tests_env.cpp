@@ -0,0 +1,151 @@
+#include "chip8_env.h"
+#include "catch2/catch.hpp"
+
+
+// Draws font sprites at random places, and scores in V3 while key 5 is held
+static const unsigned char env_game[] = {
+    0xC0, 0x3F, // 200: RND V0, 3F
+    0xC1, 0x1F, // 202: RND V1, 1F
+    0xF0, 0x29, // 204: LD F, V0
+    0xD0, 0x15, // 206: DRW V0, V1, 5
+    0x62, 0x05, // 208: LD V2, 5
+    0xE2, 0xA1, // 20A: SKNP V2
+    0x73, 0x01, // 20C: ADD V3, 1
+    0x12, 0x00, // 20E: JP 200
+};
+
+static float scoreV3(const Chip8& machine, void* user) {
+    return machine.V[3];
+}
+
+
+TEST_CASE( "Env - stepping is deterministic and thread count independent" ) {
+    const int instances = 16;
+    Chip8Env single(instances, 1);
+    Chip8Env threaded(instances, 4);
+    single.loadRom(env_game, sizeof(env_game));
+    threaded.loadRom(env_game, sizeof(env_game));
+    single.score_fn = threaded.score_fn = scoreV3;
+
+    std::vector<unsigned char> obs_a(instances*Chip8Env::OBSERVATION_SIZE), obs_b(obs_a.size());
+    std::vector<float> rewards_a(instances), rewards_b(instances);
+    std::vector<unsigned char> dones_a(instances), dones_b(instances);
+    std::vector<unsigned short> actions(instances);
+
+    single.reset(7, obs_a.data());
+    threaded.reset(7, obs_b.data());
+    REQUIRE( obs_a == obs_b );
+
+    for (int step=0; step<50; step++) {
+        for (int i=0; i<instances; i++) {
+            actions[i] = (i + step) % 3 == 0 ? 1 << 5 : 0;
+        }
+        single.step(actions.data(), 2, obs_a.data(), rewards_a.data(), dones_a.data());
+        threaded.step(actions.data(), 2, obs_b.data(), rewards_b.data(), dones_b.data());
+        REQUIRE( obs_a == obs_b );
+        REQUIRE( rewards_a == rewards_b );
+        REQUIRE( dones_a == dones_b );
+    }
+
+    // instances are seeded apart, so they don't all draw the same screen
+    bool differ = false;
+    for (int i=1; i<instances; i++) {
+        differ |= memcmp(&obs_a[0], &obs_a[i*Chip8Env::OBSERVATION_SIZE], Chip8Env::OBSERVATION_SIZE) != 0;
+    }
+    REQUIRE( differ == true );
+}
+
+
+TEST_CASE( "Env - rewards and done flags" ) {
+    Chip8Env env(2, 2);
+    env.loadRom(env_game, sizeof(env_game));
+    env.score_fn = scoreV3;
+
+    unsigned char obs[2*Chip8Env::OBSERVATION_SIZE];
+    float rewards[2];
+    unsigned char dones[2];
+    unsigned short actions[2] = { 1 << 5, 0 };
+
+    env.reset(1, obs);
+    env.step(actions, 4, obs, rewards, dones);
+    REQUIRE( rewards[0] > 0 );
+    REQUIRE( rewards[1] == 0 );
+    REQUIRE( dones[0] == 0 );
+
+    // running off the end of the game faults, which ends the episode
+    env.machines[1].pc = 0x0300;
+    env.step(actions, 1, obs, rewards, dones);
+    REQUIRE( dones[0] == 0 );
+    REQUIRE( dones[1] == 1 );
+
+    env.resetInstance(1, 1, &obs[Chip8Env::OBSERVATION_SIZE]);
+    env.step(actions, 1, obs, rewards, dones);
+    REQUIRE( dones[1] == 0 );
+}
+
+
+TEST_CASE( "Env - frame skip, flicker max and downsampling" ) {
+    // toggles the "0" glyph at (0, 0) once per frame, using the delay timer
+    static const unsigned char blink_game[] = {
+        0xA0, 0x00, // 200: LD I, 0
+        0xD0, 0x05, // 202: DRW V0, V0, 5
+        0x61, 0x01, // 204: LD V1, 1
+        0xF1, 0x15, // 206: LD DT, V1
+        0xF1, 0x07, // 208: LD V1, DT
+        0x31, 0x00, // 20A: SE V1, 0
+        0x12, 0x08, // 20C: JP 208
+        0x12, 0x02, // 20E: JP 202
+    };
+    Chip8Env env(1, 1);
+    env.loadRom(blink_game, sizeof(blink_game));
+
+    unsigned char obs[Chip8Env::OBSERVATION_SIZE];
+    float reward;
+    unsigned char done;
+    unsigned short no_keys = 0;
+
+    env.reset(0, obs);
+    env.step(&no_keys, 1, obs, &reward, &done);
+    REQUIRE( obs[0] == 0xF0 );
+    REQUIRE( obs[8] == 0x90 );
+    env.step(&no_keys, 1, obs, &reward, &done);
+    REQUIRE( obs[0] == 0x00 );
+
+    // frame skip only sees the last frame, where the glyph is erased
+    env.reset(0, obs);
+    env.step(&no_keys, 2, obs, &reward, &done);
+    REQUIRE( obs[0] == 0x00 );
+
+    // unless flicker_max keeps the frame before it
+    env.flicker_max = true;
+    env.reset(0, obs);
+    env.step(&no_keys, 2, obs, &reward, &done);
+    REQUIRE( obs[0] == 0xF0 );
+
+    // 2x2 max pooling: F0 90 90 90 F0 becomes C0 C0 C0 at 32x16, 4 bytes per row
+    env.flicker_max = false;
+    REQUIRE( env.setDownsample(2) );
+    REQUIRE( env.observationSize() == 64 );
+    env.reset(0, obs);
+    env.step(&no_keys, 1, obs, &reward, &done);
+    REQUIRE( obs[0] == 0xC0 );
+    REQUIRE( obs[4] == 0xC0 );
+    REQUIRE( obs[8] == 0xC0 );
+    REQUIRE( obs[12] == 0x00 );
+    REQUIRE( obs[1] == 0x00 );
+
+    // blocks that don't tile the screen would spill past rows and the buffer
+    REQUIRE_FALSE( env.setDownsample(3) );
+    REQUIRE_FALSE( env.setDownsample(0) );
+    REQUIRE_FALSE( env.setDownsample(64) );
+    REQUIRE( env.downsample == 2 );
+
+    // the coarsest, 2x1 bits rounded up to a byte: the glyph is in the left one
+    REQUIRE( env.setDownsample(32) );
+    REQUIRE( env.observationSize() == 1 );
+    obs[1] = 0xAA;
+    env.reset(0, obs);
+    env.step(&no_keys, 1, obs, &reward, &done);
+    REQUIRE( obs[0] == 0x80 );
+    REQUIRE( obs[1] == 0xAA );
+}
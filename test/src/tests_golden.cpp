@@ -0,0 +1,83 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <map>
+#include "chip8_movie.h"
+#include "catch2/catch.hpp"
+
+// Every bundled game is run headless with scripted input, and its screen hash
+// compared to test/golden/frames.txt at fixed frames. Run
+//   CHIP8_UPDATE_GOLDEN=1 ./bin/tests "[golden]"
+// to rewrite the file after a change that is meant to alter the output.
+
+static const char* golden_games[] = {
+    "15PUZZLE", "BC_test.ch8", "BLINKY", "BLITZ", "BRIX", "CONNECT4", "GUESS",
+    "HIDDEN", "INVADERS", "KALEID", "MAZE", "MERLIN", "MISSILE", "PONG", "PONG2",
+    "PUZZLE", "SYZYGY", "TANK", "TETRIS", "TICTAC", "UFO", "VBRIX", "VERS", "WIPEOFF"
+};
+
+static const unsigned int golden_frames[] = { 60, 300, 1200, 3000 };
+
+
+// Holds each key in turn for half a second, with a gap in between, so games
+// both see input and get to run without it
+static unsigned short scriptedKeys(unsigned int frame) {
+    if (frame % 30 >= 20) {
+        return 0;
+    }
+    static const unsigned char order[] = { 5, 4, 6, 8, 2, 7, 9, 1, 3, 0xA, 0xB, 0xC, 0xD, 0xE, 0xF, 0 };
+    return 1 << order[frame / 30 % 16];
+}
+
+
+TEST_CASE( "Golden frames - bundled games", "[golden]" ) {
+    const std::string golden_path = CHIP8_SOURCE_DIR "/test/golden/frames.txt";
+    const bool update = getenv("CHIP8_UPDATE_GOLDEN") != NULL;
+
+    std::map<std::string, unsigned long long> golden;
+    FILE* file = fopen(golden_path.c_str(), "r");
+    if (file) {
+        char line[256], game[64];
+        unsigned int frame;
+        unsigned long long hash;
+        while (fgets(line, sizeof(line), file)) {
+            if (sscanf(line, "%63s %u %llx", game, &frame, &hash) == 3 && game[0] != '#') {
+                golden[std::string(game) + "@" + std::to_string(frame)] = hash;
+            }
+        }
+        fclose(file);
+    }
+    REQUIRE( (update || !golden.empty()) );
+
+    std::string out = "# game frame screen_hash\n";
+    for (const char* name : golden_games) {
+        Chip8 chip8;
+        REQUIRE( chip8.loadGame((CHIP8_SOURCE_DIR "/games/" + std::string(name)).c_str()) );
+
+        unsigned int frame = 0;
+        for (unsigned int checkpoint : golden_frames) {
+            for (; frame < checkpoint; frame++) {
+                Chip8Movie::setKeys(chip8, scriptedKeys(frame));
+                chip8.runFrame();
+            }
+            unsigned long long hash = Chip8Movie::displayHash(chip8);
+            char line[128];
+            snprintf(line, sizeof(line), "%s %u %016llx\n", name, frame, hash);
+            out += line;
+
+            if (!update) {
+                INFO( name << " at frame " << frame );
+                std::string key = std::string(name) + "@" + std::to_string(frame);
+                REQUIRE( golden.count(key) == 1 );
+                CHECK( golden[key] == hash );
+            }
+        }
+    }
+
+    if (update) {
+        file = fopen(golden_path.c_str(), "w");
+        REQUIRE( file != NULL );
+        fputs(out.c_str(), file);
+        fclose(file);
+    }
+}
@@ -0,0 +1,176 @@
+#include <vector>
+#include "chip8_history.h"
+#include "chip8_movie.h"
+#include "catch2/catch.hpp"
+
+
+// Draws at random places, waits on the delay timer, counts frames with key 5
+static const unsigned char history_game[] = {
+    0xC0, 0x3F, // 200: RND V0, 3F
+    0xC1, 0x1F, // 202: RND V1, 1F
+    0xF0, 0x29, // 204: LD F, V0
+    0xD0, 0x15, // 206: DRW V0, V1, 5
+    0xF2, 0x07, // 208: LD V2, DT
+    0x32, 0x00, // 20A: SE V2, 0
+    0x12, 0x08, // 20C: JP 208
+    0x63, 0x05, // 20E: LD V3, 5
+    0xF3, 0x15, // 210: LD DT, V3
+    0xE3, 0xA1, // 212: SKNP V3
+    0x74, 0x01, // 214: ADD V4, 1
+    0x12, 0x00, // 216: JP 200
+};
+
+struct Point {
+    unsigned long long instructions;
+    unsigned long long hash;
+};
+
+
+TEST_CASE( "History - seeking reproduces past states" ) {
+    Chip8 a;
+    a.loadRom(history_game, sizeof(history_game));
+    a.clock = 4000; // a few snapshots
+    Chip8History history;
+    history.reset(a);
+
+    std::vector<Point> points;
+    for (int frame=0; frame<3000; frame++) {
+        Chip8Movie::setKeys(a, frame / 40 % 3 == 0 ? 1 << 5 : 0);
+        a.runFrame();
+        history.frameDone(a);
+        if (frame % 250 == 0) {
+            a.step();
+            history.stepped(a);
+        }
+        if (frame % 100 == 0) {
+            Point point = { a.instructions, a.stateHash() };
+            points.push_back(point);
+        }
+    }
+    REQUIRE( history.snapshots.size() > 5 );
+    REQUIRE_FALSE( history.seek(a, a.instructions + 1) );
+
+    for (size_t i = points.size(); i-- > 0; ) {
+        REQUIRE( history.seek(a, points[i].instructions) );
+        REQUIRE( a.instructions == points[i].instructions );
+        REQUIRE( a.stateHash() == points[i].hash );
+    }
+}
+
+
+// Frames cut short by a breakpoint are recorded without their timer tick
+TEST_CASE( "History - seeking past breakpoint stops" ) {
+    Chip8 a;
+    a.loadRom(history_game, sizeof(history_game));
+    unsigned char flags[Chip8::RAM_SIZE] = {};
+    a.debug_flags = flags;
+    a.setDebugFlags(0x216, DEBUG_BREAK);
+    Chip8History history;
+    history.reset(a);
+
+    std::vector<Point> points;
+    for (int frame=0; frame<300; frame++) {
+        a.runFrame();
+        history.frameDone(a);
+        if (a.debug_break.active) {
+            Point point = { a.instructions, a.stateHash() };
+            points.push_back(point);
+            a.resume();
+        }
+    }
+    REQUIRE( points.size() > 10 );
+
+    for (size_t i = points.size(); i-- > 0; ) {
+        REQUIRE( history.seek(a, points[i].instructions) );
+        REQUIRE( a.stateHash() == points[i].hash );
+    }
+}
+
+// A faulted machine only adds ticks to the last segment, not a segment a frame
+TEST_CASE( "History - faulted frames" ) {
+    unsigned char game[] = {
+        0x60, 0xFF, // 200: LD V0, FF
+        0xF0, 0x15, // 202: LD DT, V0
+        0xE0, 0xFF, // 204: unknown, faults
+    };
+    Chip8 a;
+    a.loadRom(game, sizeof(game));
+    Chip8History history;
+    history.reset(a);
+    for (int frame=0; frame<100; frame++) {
+        a.runFrame();
+        history.frameDone(a);
+    }
+    REQUIRE( a.fault.active );
+    REQUIRE( history.segments.size() == 1 );
+    REQUIRE( history.segments.back().ticks == 100 );
+
+    unsigned long long hash = a.stateHash();
+    REQUIRE( history.seek(a, a.instructions) );
+    REQUIRE( a.delay_timer == 0xFF - 100 );
+    REQUIRE( a.stateHash() == hash );
+}
+
+TEST_CASE( "History - stepping back" ) {
+    Chip8 a;
+    a.loadRom(history_game, sizeof(history_game));
+    Chip8History history;
+    history.reset(a);
+    for (int frame=0; frame<500; frame++) {
+        a.runFrame();
+        history.frameDone(a);
+    }
+
+    std::vector<unsigned long long> hashes;
+    for (int i=0; i<3; i++) {
+        a.step();
+        history.stepped(a);
+        hashes.push_back(a.stateHash());
+    }
+
+    REQUIRE( history.stepBack(a) );
+    REQUIRE( a.stateHash() == hashes[1] );
+    REQUIRE( history.stepBack(a) );
+    REQUIRE( a.stateHash() == hashes[0] );
+
+    // forward again from there, the same way
+    a.step();
+    history.stepped(a);
+    REQUIRE( a.stateHash() == hashes[1] );
+    REQUIRE( history.stepBack(a) );
+    REQUIRE( a.stateHash() == hashes[0] );
+}
+
+
+TEST_CASE( "History - continuing back to breakpoints" ) {
+    Chip8 a;
+    a.loadRom(history_game, sizeof(history_game));
+    unsigned char flags[Chip8::RAM_SIZE] = {};
+    a.debug_flags = flags;
+    Chip8History history;
+    history.reset(a);
+    for (int frame=0; frame<600; frame++) {
+        Chip8Movie::setKeys(a, frame >= 100 && frame < 120 ? 1 << 5 : 0);
+        a.runFrame();
+        history.frameDone(a);
+    }
+    unsigned char presses = a.V[4];
+    REQUIRE( presses > 1 );
+
+    // back to the last ADD V4 that ran
+    a.setDebugFlags(0x214, DEBUG_BREAK);
+    REQUIRE( history.continueBack(a) );
+    REQUIRE( a.debug_break.active );
+    REQUIRE( a.pc == 0x214 );
+    REQUIRE( a.V[4] == presses - 1 );
+
+    REQUIRE( history.continueBack(a) );
+    REQUIRE( a.pc == 0x214 );
+    REQUIRE( a.V[4] == presses - 2 );
+
+    // nothing before the first: back to the start
+    a.setDebugFlags(0x214, 0);
+    REQUIRE_FALSE( history.continueBack(a) );
+    REQUIRE( a.instructions == 0 );
+    REQUIRE( a.pc == 0x200 );
+}
@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include "chip8_movie.h"
+#include "catch2/catch.hpp"
+
+
+// Draws font sprites at random places, and moves a counter while key 5 is held
+static const unsigned char movie_game[] = {
+    0xC0, 0x3F, // 200: RND V0, 3F
+    0xC1, 0x1F, // 202: RND V1, 1F
+    0xF0, 0x29, // 204: LD F, V0
+    0xD0, 0x15, // 206: DRW V0, V1, 5
+    0x62, 0x05, // 208: LD V2, 5
+    0xE2, 0xA1, // 20A: SKNP V2
+    0x73, 0x01, // 20C: ADD V3, 1
+    0x12, 0x00, // 20E: JP 200
+};
+
+
+static Chip8Movie record(Chip8& machine, unsigned int frames) {
+    Chip8Movie movie;
+    machine.loadRom(movie_game, sizeof(movie_game));
+    movie.startRecording(machine, 1234);
+    for (unsigned int f=0; f<frames; f++) {
+        Chip8Movie::setKeys(machine, 1 << (f / 50 % 8));
+        movie.recordFrame(machine);
+    }
+    return movie;
+}
+
+
+TEST_CASE( "Movie - playback reproduces the recording" ) {
+    Chip8 recorded;
+    Chip8Movie movie = record(recorded, 2000);
+    REQUIRE( movie.frames == 2000 );
+    REQUIRE( movie.runs.size() == 40 ); // one run per 50 frames of the same keys
+    REQUIRE( movie.checkpoints.size() == 2000 / Chip8Movie::CHECKPOINT_INTERVAL );
+
+    const char* path = "movie_test.c8m";
+    REQUIRE( movie.save(path) );
+    Chip8Movie loaded;
+    REQUIRE( loaded.load(path) );
+    remove(path);
+    REQUIRE( loaded.frames == movie.frames );
+    REQUIRE( loaded.seed == 1234 );
+
+    Chip8 played;
+    played.loadRom(movie_game, sizeof(movie_game));
+    REQUIRE( loaded.startPlayback(played) );
+    while (loaded.playFrame(played)) {
+    }
+    REQUIRE( loaded.finished() );
+    REQUIRE( loaded.frame == 2000 );
+    REQUIRE( loaded.desync_frame == -1 );
+    REQUIRE( loaded.checkpoint_index == loaded.checkpoints.size() );
+    REQUIRE( played.stateHash() == recorded.stateHash() );
+}
+
+
+TEST_CASE( "Movie - desyncs and other games are reported" ) {
+    Chip8 recorded;
+    Chip8Movie movie = record(recorded, 1300);
+
+    Chip8 other;
+    unsigned char other_game[] = { 0x12, 0x00 };
+    other.loadRom(other_game, sizeof(other_game));
+    REQUIRE_FALSE( movie.startPlayback(other) );
+
+    movie.checkpoints[1].display_hash ^= 1;
+    Chip8 played;
+    played.loadRom(movie_game, sizeof(movie_game));
+    REQUIRE( movie.startPlayback(played) );
+    while (movie.playFrame(played)) {
+    }
+    REQUIRE( movie.desync_frame == 2 * Chip8Movie::CHECKPOINT_INTERVAL );
+}
+
+
+TEST_CASE( "Movie - XO-CHIP games too big for 4KB replay from files" ) {
+    // the movie's quirks decide how much memory the game gets when loaded
+    unsigned char game[5000] = {};
+    memcpy(game, movie_game, sizeof(movie_game));
+    const char* game_path = "movie_test_xochip.ch8";
+    FILE* file = fopen(game_path, "wb");
+    REQUIRE( file != NULL );
+    fwrite(game, 1, sizeof(game), file);
+    fclose(file);
+
+    Chip8 recorded;
+    REQUIRE( recorded.loadGame(game_path, QUIRKS_XOCHIP) );
+    Chip8Movie movie;
+    movie.startRecording(recorded, 99);
+    for (unsigned int f=0; f<300; f++) {
+        Chip8Movie::setKeys(recorded, f % 100 < 50 ? 1 << 5 : 0);
+        movie.recordFrame(recorded);
+    }
+    const char* path = "movie_test_xochip.c8m";
+    REQUIRE( movie.save(path) );
+
+    Chip8Movie loaded;
+    REQUIRE( loaded.load(path) );
+    remove(path);
+    REQUIRE( loaded.quirks == QUIRKS_XOCHIP );
+    Chip8 classic;
+    REQUIRE_FALSE( classic.loadGame(game_path) );
+    Chip8 played;
+    REQUIRE( played.loadGame(game_path, loaded.quirks) );
+    remove(game_path);
+    REQUIRE( loaded.startPlayback(played) );
+    while (loaded.playFrame(played)) {
+    }
+    REQUIRE( loaded.frame == 300 );
+    REQUIRE( loaded.desync_frame == -1 );
+    REQUIRE( played.stateHash() == recorded.stateHash() );
+}
@@ -0,0 +1,96 @@
+#include "chip8_pacer.h"
+#include "catch2/catch.hpp"
+
+
+// Presents every period_us, plus jitter_us every other one, and returns the
+// frames run over the given number of presents
+static int presentFor(Chip8Pacer& pacer, double& clock_us, double period_us, int presents, double jitter_us = 0, int* most = NULL) {
+    int frames = 0;
+    for (int i=0; i<presents; i++) {
+        int owed = pacer.framesOwed(true);
+        frames += owed;
+        if (most && owed > *most) {
+            *most = owed;
+        }
+        clock_us += period_us + (i % 2 ? jitter_us : -jitter_us);
+        pacer.presentedAt(clock_us);
+    }
+    return frames;
+}
+
+
+TEST_CASE( "Pacer - frames per refresh" ) {
+    double clock_us = 0;
+
+    // a 60Hz display with vsync runs a frame every refresh, even with presents
+    // jittering by a millisecond
+    Chip8Pacer sixty(60);
+    presentFor(sixty, clock_us, 1000000.0/60, Chip8Pacer::SAMPLES + 1);
+    REQUIRE( sixty.measured );
+    REQUIRE( sixty.vsync );
+    int most = 0;
+    REQUIRE( presentFor(sixty, clock_us, 1000000.0/60, 600, 1000, &most) == 600 );
+    REQUIRE( most == 1 );
+
+    // close enough to 60Hz locks to the display too
+    Chip8Pacer ntsc(59.94);
+    presentFor(ntsc, clock_us, 1000000.0/59.94, Chip8Pacer::SAMPLES + 1);
+    REQUIRE( presentFor(ntsc, clock_us, 1000000.0/59.94, 600, 500) == 600 );
+
+    // faster displays run 60 frames a second, and never more than one at once
+    Chip8Pacer fast(144);
+    presentFor(fast, clock_us, 1000000.0/144, Chip8Pacer::SAMPLES + 1);
+    REQUIRE( fast.vsync );
+    REQUIRE( fast.refresh_us == Approx(1000000.0/144) );
+    most = 0;
+    REQUIRE( presentFor(fast, clock_us, 1000000.0/144, 1440, 500, &most) == Approx(600).margin(1) );
+    REQUIRE( most == 1 );
+
+    Chip8Pacer double_rate(120);
+    presentFor(double_rate, clock_us, 1000000.0/120, Chip8Pacer::SAMPLES + 1);
+    for (int i=0; i<10; i++) {
+        REQUIRE( presentFor(double_rate, clock_us, 1000000.0/120, 2, 1000) == 1 );
+    }
+}
+
+TEST_CASE( "Pacer - missed refreshes and pauses" ) {
+    double clock_us = 0;
+    Chip8Pacer pacer(60);
+    presentFor(pacer, clock_us, 1000000.0/60, Chip8Pacer::SAMPLES + 1);
+
+    // a present that took 3 refreshes catches up, the measured rate stays
+    clock_us += 3*1000000.0/60;
+    pacer.presentedAt(clock_us);
+    REQUIRE( pacer.framesOwed(true) == 3 );
+    REQUIRE( pacer.refresh_us == Approx(1000000.0/60) );
+
+    // a stall doesn't make a burst
+    clock_us += 1000000;
+    pacer.presentedAt(clock_us);
+    REQUIRE( pacer.framesOwed(true) == Chip8Pacer::MAX_FRAMES );
+
+    // nothing is owed for the time paused
+    REQUIRE( pacer.framesOwed(false) == 0 );
+    clock_us += 1000000.0/60;
+    pacer.presentedAt(clock_us);
+    REQUIRE( pacer.framesOwed(true) == 1 );
+}
+
+TEST_CASE( "Pacer - without vsync" ) {
+    // swaps that return right away: the game still runs at game speed, from
+    // the time that went by
+    double clock_us = 0;
+    Chip8Pacer pacer(60);
+    presentFor(pacer, clock_us, 200, Chip8Pacer::SAMPLES + 1);
+    REQUIRE( pacer.measured );
+    REQUIRE_FALSE( pacer.vsync );
+    REQUIRE( pacer.refresh_us == Approx(pacer.frame_us) );
+    REQUIRE( presentFor(pacer, clock_us, 5000, 200) == 60 );
+
+    // and waits for its own deadlines, without oversleeping them by much
+    double target_us = Chip8Pacer::now() + 20000;
+    pacer.sleepUntil(target_us);
+    double woken_us = Chip8Pacer::now();
+    REQUIRE( woken_us >= target_us );
+    REQUIRE( woken_us < target_us + 5000 );
+}
@@ -0,0 +1,112 @@
+#include <thread>
+#include "chip8_stats.h"
+#include "chip8_env.h"
+#include "catch2/catch.hpp"
+
+
+// Draws a digit and waits for a key, over and over
+static const unsigned char stats_game[] = {
+    0xD0, 0x05, // 200: DRW V0, V0, 5
+    0xF1, 0x0A, // 202: LD V1, K
+    0x12, 0x00, // 204: JP 200
+};
+
+
+TEST_CASE( "Stats - published counters read back" ) {
+    Chip8Env env(2, 1);
+    env.loadRom(stats_game, sizeof(stats_game));
+    Chip8Stats stats;
+    REQUIRE( stats.open(2) );
+    env.stats = &stats;
+
+    Chip8Stats reader;
+    REQUIRE( reader.attach(stats.name) );
+    REQUIRE( reader.header->instances == 2 );
+    Chip8StatsCounters counters;
+    REQUIRE( reader.read(1, counters) );
+    REQUIRE( counters.frames == 0 );
+    REQUIRE_FALSE( reader.read(2, counters) );
+
+    // with no key held, the machines draw once and wait from then on
+    std::vector<unsigned char> observations(2*Chip8Env::OBSERVATION_SIZE), dones(2);
+    std::vector<float> rewards(2);
+    std::vector<unsigned short> actions(2, 0);
+    env.reset(0, observations.data());
+    env.step(actions.data(), 10, observations.data(), rewards.data(), dones.data());
+    stats.setAudioUnderruns(0, 3);
+    env.step(actions.data(), 10, observations.data(), rewards.data(), dones.data());
+
+    REQUIRE( reader.read(0, counters) );
+    REQUIRE( counters.frames == 20 );
+    REQUIRE( counters.instructions == env.machines[0].instructions );
+    REQUIRE( counters.draws == 1 );
+    REQUIRE( counters.idle == counters.instructions - 1 );
+    REQUIRE( counters.audio_underruns == 3 );
+    unsigned long long timed = 0;
+    for (int i=0; i<Chip8StatsCounters::FRAME_TIME_BUCKETS; i++) {
+        timed += counters.frame_time[i];
+    }
+    REQUIRE( timed == 20 );
+
+    // resets start the machine counters over, the totals keep going
+    env.resetInstance(0, 1, observations.data());
+    env.step(actions.data(), 30, observations.data(), rewards.data(), dones.data());
+    REQUIRE( reader.read(0, counters) );
+    REQUIRE( counters.frames == 50 );
+    REQUIRE( counters.draws == 2 );
+
+    // the segment goes away with its writer
+    char name[sizeof(stats.name)];
+    memcpy(name, stats.name, sizeof(name));
+    stats.close();
+    Chip8Stats late;
+    REQUIRE_FALSE( late.attach(name) );
+}
+
+TEST_CASE( "Stats - reads are never torn" ) {
+    Chip8Stats stats;
+    REQUIRE( stats.open(1) );
+    Chip8Stats reader;
+    REQUIRE( reader.attach(stats.name) );
+
+    // every count moves together, so a read that mixes two updates shows
+    std::atomic<bool> done(false);
+    std::thread writer([&]() {
+        Chip8 machine;
+        for (unsigned int i=1; i<=200000; i++) {
+            machine.instructions = machine.frames = machine.draws = machine.key_waits = i;
+            stats.record(0, machine, 1);
+        }
+        done = true;
+    });
+    int reads = 0, torn = 0;
+    while (!done) {
+        Chip8StatsCounters c;
+        if (reader.read(0, c)) {
+            torn += c.frames != c.instructions || c.draws != c.instructions || c.idle != c.instructions
+                 || c.frame_time[0] != c.instructions;
+            reads++;
+        }
+    }
+    writer.join();
+    REQUIRE( reads > 0 );
+    REQUIRE( torn == 0 );
+}
+
+TEST_CASE( "Stats - every open gets a segment of its own" ) {
+    Chip8Stats first, second;
+    REQUIRE( first.open(1) );
+    REQUIRE( second.open(3) );
+    REQUIRE( strcmp(first.name, second.name) != 0 );
+
+    // the second open left the first one's segment alone
+    Chip8Stats reader;
+    REQUIRE( reader.attach(first.name) );
+    REQUIRE( reader.header->instances == 1 );
+    REQUIRE( reader.attach(second.name) );
+    REQUIRE( reader.header->instances == 3 );
+
+    // writer side copies don't share cache lines either
+    REQUIRE( sizeof(Chip8StatsLocal) % 64 == 0 );
+    REQUIRE( (size_t)&first.local[0] % 64 == 0 );
+}
@@ -0,0 +1,61 @@
+#!/bin/sh
+# Two stage profile guided, link time optimised build: builds an
+# instrumented chip8_bench, trains it on every game in games/, then rebuilds
+# everything with the profiles and LTO, and reports the speedup over a plain
+# release build.
+#
+#   tools/pgo_build.sh [build directory, default build-pgo]
+#
+# The optimised binaries end up in bin/ and tools/bin/ as usual.
+
+set -e
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+BUILD=${1:-$ROOT/build-pgo}
+mkdir -p "$BUILD"
+BUILD=$(cd "$BUILD" && pwd)
+PROFILES=$BUILD/profiles
+BENCH="--frames 3000"
+
+# the games, without their notes
+set --
+for game in "$ROOT"/games/*; do
+    case "$game" in
+        *.txt) ;;
+        *) set -- "$@" "$game" ;;
+    esac
+done
+
+echo "== baseline release build"
+cmake -S "$ROOT" -B "$BUILD/baseline" -DCMAKE_BUILD_TYPE=Release -DCHIP8_TESTS=OFF -DCHIP8_GUI=OFF > /dev/null
+rm -f "$ROOT/tools/bin/chip8_bench" # shared by every build directory, make sure it's relinked
+cmake --build "$BUILD/baseline" --target chip8_bench -j
+cp "$ROOT/tools/bin/chip8_bench" "$BUILD/chip8_bench_baseline"
+
+echo "== instrumented build"
+rm -rf "$PROFILES"
+cmake -S "$ROOT" -B "$BUILD/pgo" -DCMAKE_BUILD_TYPE=Release -DCHIP8_TESTS=OFF \
+      -DCHIP8_PGO=generate -DCHIP8_PGO_DIR="$PROFILES" -DCHIP8_LTO=OFF > /dev/null
+cmake --build "$BUILD/pgo" --target chip8_bench -j --clean-first
+
+echo "== training run"
+"$ROOT/tools/bin/chip8_bench" "$@" $BENCH > /dev/null
+if ls "$PROFILES"/*.profraw > /dev/null 2>&1; then
+    llvm-profdata merge -o "$PROFILES/merged.profdata" "$PROFILES"/*.profraw
+fi
+
+echo "== optimised build"
+cmake -S "$ROOT" -B "$BUILD/pgo" -DCHIP8_PGO=use -DCHIP8_LTO=ON > /dev/null
+cmake --build "$BUILD/pgo" -j --clean-first
+cp "$ROOT/tools/bin/chip8_bench" "$BUILD/chip8_bench_pgo"
+
+echo "== benchmark"
+"$BUILD/chip8_bench_baseline" "$@" $BENCH | grep -v "^Loading" > "$BUILD/baseline.txt"
+"$BUILD/chip8_bench_pgo" "$@" $BENCH | grep -v "^Loading" > "$BUILD/pgo.txt"
+
+{
+    printf "%-12s %14s %14s %8s\n" game "baseline MIPS" "PGO+LTO MIPS" speedup
+    awk 'NR == FNR { baseline[$1] = $5; next }
+         { printf "%-12s %14.1f %14.1f %7.2fx\n", $1, baseline[$1], $5, $5 / baseline[$1] }' \
+        "$BUILD/baseline.txt" "$BUILD/pgo.txt"
+} | tee "$BUILD/report.txt"
@@ -0,0 +1,90 @@
+// Interpreter throughput over a set of games, run headless with scripted
+// input at a clock far above real hardware so the time goes to the
+// interpreter rather than to games waiting on their timers. Also the
+// training run for profile guided builds, see tools/pgo_build.sh.
+//
+//   ./bin/chip8_bench ../games/*
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include "chip8.h"
+#include "chip8_movie.h"
+
+
+static void usage() {
+    printf("Usage: ./chip8_bench path/to/game... [options]\n"
+           "  --frames N   frames to run each game for (default 3000)\n"
+           "  --clock HZ   instructions per second (default 200000)\n"
+           "  --quirks chip8|cosmac|schip|xochip\n");
+}
+
+
+// Holds each key in turn for half a second, with a gap in between
+static unsigned short scriptedKeys(unsigned int frame) {
+    if (frame % 30 >= 20) {
+        return 0;
+    }
+    return 1 << (frame / 30 % 16);
+}
+
+
+int main(int argc, char* argv[]) {
+    unsigned int frames = 3000;
+    unsigned int clock = 200000;
+    Chip8Quirks quirks = QUIRKS_CHIP8;
+    const char* games[256];
+    int game_count = 0;
+
+    for (int i=1; i<argc; i++) {
+        const char* value = i + 1 < argc ? argv[i + 1] : "";
+        if (strcmp(argv[i], "--frames") == 0) {
+            frames = atoi(value);
+            i++;
+        } else if (strcmp(argv[i], "--clock") == 0) {
+            clock = atoi(value);
+            i++;
+        } else if (strcmp(argv[i], "--quirks") == 0) {
+            quirks = strcmp(value, "cosmac") == 0 ? QUIRKS_COSMAC : strcmp(value, "schip") == 0 ? QUIRKS_SCHIP : strcmp(value, "xochip") == 0 ? QUIRKS_XOCHIP : QUIRKS_CHIP8;
+            i++;
+        } else if (argv[i][0] == '-' || game_count == 256) {
+            usage();
+            return 1;
+        } else {
+            games[game_count++] = argv[i];
+        }
+    }
+    if (game_count == 0) {
+        usage();
+        return 0;
+    }
+
+    unsigned long long total_instructions = 0;
+    double total_seconds = 0;
+    for (int g=0; g<game_count; g++) {
+        Chip8 chip8;
+        if (!chip8.loadGame(games[g], quirks)) {
+            printf("Problem loading the provided game: %s\n", games[g]);
+            return 1;
+        }
+        chip8.clock = clock;
+
+        unsigned long long instructions = 0;
+        auto begin = std::chrono::high_resolution_clock::now();
+        for (unsigned int f=0; f<frames && !chip8.fault.active; f++) {
+            Chip8Movie::setKeys(chip8, scriptedKeys(f));
+            instructions += chip8.runFrame();
+        }
+        std::chrono::duration<double> seconds = std::chrono::high_resolution_clock::now() - begin;
+
+        const char* name = strrchr(games[g], '/') ? strrchr(games[g], '/') + 1 : games[g];
+        printf("%-12s %12llu instructions %8.3fs %8.1f MIPS%s\n", name, instructions, seconds.count(),
+               instructions / seconds.count() / 1e6, chip8.fault.active ? "  (faulted)" : "");
+        total_instructions += instructions;
+        total_seconds += seconds.count();
+    }
+    printf("total        %12llu instructions %8.3fs %8.1f MIPS\n", total_instructions, total_seconds,
+           total_instructions / total_seconds / 1e6);
+    return 0;
+}
@@ -0,0 +1,118 @@
+// Headless movie playback: replays a movie recorded with the GUI as fast as
+// the host goes, checks the screen at every recorded checkpoint and reports
+// where playback first went out of sync. Can also turn the movie into a GIF.
+//
+//   ./bin/chip8_play ../games/PONG pong.c8m --screen
+//   ./bin/chip8_play ../games/PONG pong.c8m --gif pong.gif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include "chip8.h"
+#include "chip8_movie.h"
+#include "chip8_capture.h"
+#include "chip8_stats.h"
+
+
+static void usage() {
+    printf("Usage: ./chip8_play path/to/game path/to/movie [options]\n"
+           "  --frames N   stop after N frames (default: the whole movie)\n"
+           "  --screen     print the screen at the end\n"
+           "  --gif FILE   capture the playback to an animated GIF\n"
+           "  --stats      publish counters while playing, see chip8_stats\n"
+           "Exits with 1 if playback went out of sync with the recording.\n");
+}
+
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        usage();
+        return 0;
+    }
+
+    unsigned int max_frames = 0;
+    bool screen = false;
+    const char* gif_file = NULL;
+    bool publish = false;
+    for (int i=3; i<argc; i++) {
+        if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            max_frames = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--screen") == 0) {
+            screen = true;
+        } else if (strcmp(argv[i], "--gif") == 0 && i + 1 < argc) {
+            gif_file = argv[++i];
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            publish = true;
+        } else {
+            usage();
+            return 1;
+        }
+    }
+
+    Chip8Movie movie;
+    if (!movie.load(argv[2])) {
+        printf("Problem loading the provided movie: %s\n", argv[2]);
+        return 1;
+    }
+    // loaded with the movie's quirks, XO-CHIP games don't fit in 4KB
+    Chip8 chip8;
+    if (!chip8.loadGame(argv[1], movie.quirks)) {
+        printf("Problem loading the provided game: %s\n", argv[1]);
+        return 1;
+    }
+    if (!movie.startPlayback(chip8)) {
+        printf("The movie was recorded on another game\n");
+        return 1;
+    }
+
+    Chip8Capture capture;
+    capture.lossless = true;
+    if (gif_file && !capture.start(gif_file, chip8)) {
+        printf("Could not write the capture to %s\n", gif_file);
+        return 1;
+    }
+
+    Chip8Stats stats;
+    if (publish && !stats.open(1)) {
+        printf("Could not publish stats\n");
+        return 1;
+    }
+
+    auto begin = std::chrono::high_resolution_clock::now();
+    auto frame_begin = begin;
+    while ((max_frames == 0 || movie.frame < max_frames) && movie.playFrame(chip8)) {
+        capture.frame(chip8);
+        if (publish) {
+            auto now = std::chrono::high_resolution_clock::now();
+            stats.record(0, chip8, std::chrono::duration_cast<std::chrono::microseconds>(now - frame_begin).count());
+            frame_begin = now;
+        }
+    }
+    capture.stop();
+    std::chrono::duration<double> seconds = std::chrono::high_resolution_clock::now() - begin;
+
+    if (screen) {
+        for (int i=0; i<chip8.displayHeight(); i++) {
+            for (int j=0; j<chip8.displayWidth(); j++) {
+                putchar(".#+*"[chip8.pixel(j, i)]);
+            }
+            putchar('\n');
+        }
+    }
+
+    printf("%u frames (%.1f minutes of play) in %.3fs, %.0fx real time\n",
+           movie.frame, movie.frame / 3600.0, seconds.count(), movie.frame / 60.0 / seconds.count());
+    if (gif_file) {
+        printf("captured %u frames to %s, %u screens dropped\n", capture.frames, gif_file, capture.dropped);
+    }
+    printf("checkpoints %zu/%zu, state hash %016llx\n", movie.checkpoint_index, movie.checkpoints.size(), chip8.stateHash());
+    if (chip8.fault.active) {
+        printf("Stopped at %#06x, opcode %#06x: %s\n", chip8.fault.pc, chip8.fault.opcode, chip8.fault.reason);
+    }
+    if (movie.desync_frame >= 0) {
+        printf("Out of sync at frame %d\n", movie.desync_frame);
+        return 1;
+    }
+    return 0;
+}
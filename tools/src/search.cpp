@@ -0,0 +1,365 @@
+// Monte-Carlo tree search over key sequences, for automated playtesting:
+// finds inputs that push a score as high as possible, or that reach as many
+// different states as possible. Worker threads share one search tree, stored
+// as a transposition table keyed by Chip8::stateHash, so states reached by
+// different key sequences share their statistics.
+//
+//   ./bin/chip8_search ../games/TETRIS --keys 4,5,6,7 --score-addr 0x2F0
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "chip8.h"
+#include "thread_pool.h"
+
+#define MAX_ACTIONS 17 // no key, or one of the 16
+#define TABLE_SHARDS 64
+
+
+struct Options {
+    const char* game;
+    Chip8Quirks quirks;
+    std::vector<unsigned short> actions; // key masks
+    int frames_per_action;
+    int depth;         // tree depth, in actions
+    int rollout;       // random actions played after leaving the tree
+    int iterations;
+    int threads;
+    int score_register; // -1 if unused
+    int score_address;  // -1 if unused
+    double exploration;
+};
+
+
+struct Node {
+    unsigned int visits;
+    double value_sum;
+    int next_untried;
+    unsigned long long child[MAX_ACTIONS]; // state hashes, 0 until expanded
+};
+
+
+// Search tree as a transposition table, sharded so threads rarely contend
+struct Table {
+    std::unordered_map<unsigned long long, Node> shards[TABLE_SHARDS];
+    std::mutex locks[TABLE_SHARDS];
+
+    int shard(unsigned long long hash) const {
+        return (int)(hash >> 58) & (TABLE_SHARDS - 1);
+    }
+
+    // Copies the node out (creating it if needed), so callers don't hold locks
+    Node get(unsigned long long hash) {
+        int s = shard(hash);
+        std::lock_guard<std::mutex> lock(locks[s]);
+        auto it = shards[s].find(hash);
+        if (it == shards[s].end()) {
+            Node node;
+            memset(&node, 0, sizeof(node));
+            it = shards[s].insert(std::make_pair(hash, node)).first;
+        }
+        return it->second;
+    }
+
+    // Claims the next untried action of a node, -1 if all were tried
+    int claimUntried(unsigned long long hash, int action_count) {
+        int s = shard(hash);
+        std::lock_guard<std::mutex> lock(locks[s]);
+        Node& node = shards[s][hash];
+        if (node.next_untried >= action_count) {
+            return -1;
+        }
+        return node.next_untried++;
+    }
+
+    void setChild(unsigned long long hash, int action, unsigned long long child) {
+        int s = shard(hash);
+        std::lock_guard<std::mutex> lock(locks[s]);
+        shards[s][hash].child[action] = child;
+    }
+
+    void update(unsigned long long hash, double value) {
+        int s = shard(hash);
+        std::lock_guard<std::mutex> lock(locks[s]);
+        Node& node = shards[s][hash];
+        node.visits++;
+        node.value_sum += value;
+    }
+
+    // Records a state as seen, returns true the first time
+    bool visit(unsigned long long hash) {
+        int s = shard(hash);
+        std::lock_guard<std::mutex> lock(locks[s]);
+        return shards[s].insert(std::make_pair(hash, Node())).second;
+    }
+
+    size_t size() {
+        size_t total = 0;
+        for (int s=0; s<TABLE_SHARDS; s++) {
+            std::lock_guard<std::mutex> lock(locks[s]);
+            total += shards[s].size();
+        }
+        return total;
+    }
+};
+
+
+struct Search {
+    Options options;
+    Chip8 root;
+    Table tree;
+    Table seen; // every state reached, for the novelty objective
+    std::atomic<int> iterations_left;
+
+    std::mutex best_lock; // held to change best_value and best_sequence together
+    std::atomic<double> best_value; // also read without the lock, to scale UCT
+    std::vector<unsigned short> best_sequence;
+};
+
+
+static double score(const Search& search, const Chip8& machine) {
+    if (search.options.score_register >= 0) {
+        return machine.V[search.options.score_register];
+    }
+    if (search.options.score_address >= 0) {
+        return machine.ram[search.options.score_address & machine.ramMask()];
+    }
+    return 0;
+}
+
+
+static void play(Search& search, Chip8& machine, unsigned short keys) {
+    for (int k=0; k<16; k++) {
+        machine.keys[k] = (keys >> k) & 1;
+    }
+    for (int f=0; f<search.options.frames_per_action; f++) {
+        machine.runFrame();
+    }
+}
+
+
+static unsigned int nextRandom(unsigned int& state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+
+// One MCTS iteration: walk down the tree with UCT, expand one new action,
+// play randomly from there and back up the result along the path. Runs on
+// the thread's own machine, reset to the root.
+static void iterate(Search& search, Chip8& machine, unsigned int& rng) {
+    const Options& options = search.options;
+    int action_count = (int)options.actions.size();
+    bool novelty = options.score_register < 0 && options.score_address < 0;
+
+    machine.restore(search.root); // only the profile's memory, not all 64KB
+    double start_score = score(search, machine);
+    std::vector<unsigned long long> path;
+    std::vector<unsigned short> sequence;
+
+    unsigned long long hash = machine.stateHash();
+    for (int depth=0; depth<options.depth && !machine.fault.active; depth++) {
+        path.push_back(hash);
+
+        int action = search.tree.claimUntried(hash, action_count);
+        bool expanding = action >= 0;
+        if (!expanding) {
+            // UCT, using the children's statistics from the table
+            Node node = search.tree.get(hash);
+            double best = -1e300;
+            double scale = std::max(1.0, search.best_value.load(std::memory_order_relaxed));
+            for (int a=0; a<action_count; a++) {
+                if (node.child[a] == 0) {
+                    continue; // claimed by another thread, not simulated yet
+                }
+                Node child = search.tree.get(node.child[a]);
+                double mean = child.visits ? child.value_sum / child.visits / scale : 0;
+                double uct = mean + options.exploration * sqrt(log((double)node.visits + 1) / (child.visits + 1));
+                if (uct > best) {
+                    best = uct;
+                    action = a;
+                }
+            }
+            if (action < 0) {
+                break;
+            }
+        }
+
+        play(search, machine, options.actions[action]);
+        sequence.push_back(options.actions[action]);
+        unsigned long long child = machine.stateHash();
+        if (expanding) {
+            search.tree.setChild(hash, action, child);
+            hash = child;
+            break;
+        }
+        hash = child;
+    }
+    path.push_back(hash);
+
+    // rollout
+    double value = 0;
+    double best_score = score(search, machine) - start_score;
+    for (int step=0; step<options.rollout && !machine.fault.active; step++) {
+        unsigned short keys = options.actions[nextRandom(rng) % action_count];
+        play(search, machine, keys);
+        sequence.push_back(keys);
+        if (novelty) {
+            value += search.seen.visit(machine.stateHash());
+        } else {
+            best_score = std::max(best_score, score(search, machine) - start_score);
+        }
+    }
+    if (!novelty) {
+        value = best_score;
+    }
+    if (machine.fault.active) {
+        value = -1;
+    }
+
+    for (size_t i=0; i<path.size(); i++) {
+        search.tree.update(path[i], value);
+    }
+
+    std::lock_guard<std::mutex> lock(search.best_lock);
+    if (value > search.best_value) {
+        search.best_value = value;
+        search.best_sequence = sequence;
+    }
+}
+
+
+static void searchThread(void* context, int begin, int end) {
+    Search& search = *(Search*)context;
+    for (int thread=begin; thread<end; thread++) {
+        unsigned int rng = 0x9E3779B9u * (thread + 1);
+        Chip8 machine;
+        while (search.iterations_left.fetch_sub(1) > 0) {
+            iterate(search, machine, rng);
+        }
+    }
+}
+
+
+static void usage() {
+    printf("Usage: ./chip8_search path/to/game [options]\n"
+           "  --quirks chip8|cosmac|schip|xochip\n"
+           "  --keys 4,5,6      keys the search may press, one at a time (default: all)\n"
+           "  --frames N        frames each key is held for (default 4)\n"
+           "  --depth N         tree depth in actions (default 40)\n"
+           "  --rollout N       random actions after leaving the tree (default 60)\n"
+           "  --iterations N    (default 20000)\n"
+           "  --threads N       (default: one per core)\n"
+           "  --score-reg X     maximise register VX\n"
+           "  --score-addr A    maximise the byte at address A\n"
+           "  --exploration C   UCT exploration constant (default 1.4)\n"
+           "Without a score, the search looks for as many different states as it can reach.\n");
+}
+
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        usage();
+        return 0;
+    }
+
+    Options options;
+    options.game = argv[1];
+    options.quirks = QUIRKS_CHIP8;
+    options.frames_per_action = 4;
+    options.depth = 40;
+    options.rollout = 60;
+    options.iterations = 20000;
+    options.threads = 0;
+    options.score_register = -1;
+    options.score_address = -1;
+    options.exploration = 1.4;
+
+    const char* keys = NULL;
+    for (int i=2; i<argc; i++) {
+        const char* value = i + 1 < argc ? argv[i + 1] : "";
+        if (strcmp(argv[i], "--quirks") == 0) {
+            if (strcmp(value, "chip8") == 0) {
+                options.quirks = QUIRKS_CHIP8;
+            } else if (strcmp(value, "cosmac") == 0) {
+                options.quirks = QUIRKS_COSMAC;
+            } else if (strcmp(value, "schip") == 0) {
+                options.quirks = QUIRKS_SCHIP;
+            } else if (strcmp(value, "xochip") == 0) {
+                options.quirks = QUIRKS_XOCHIP;
+            } else {
+                usage();
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--keys") == 0) {
+            keys = value;
+        } else if (strcmp(argv[i], "--frames") == 0) {
+            options.frames_per_action = atoi(value);
+        } else if (strcmp(argv[i], "--depth") == 0) {
+            options.depth = atoi(value);
+        } else if (strcmp(argv[i], "--rollout") == 0) {
+            options.rollout = atoi(value);
+        } else if (strcmp(argv[i], "--iterations") == 0) {
+            options.iterations = atoi(value);
+        } else if (strcmp(argv[i], "--threads") == 0) {
+            options.threads = atoi(value);
+        } else if (strcmp(argv[i], "--score-reg") == 0) {
+            options.score_register = (int)strtol(value, NULL, 16) & 0x0F;
+        } else if (strcmp(argv[i], "--score-addr") == 0) {
+            options.score_address = (int)strtol(value, NULL, 0);
+        } else if (strcmp(argv[i], "--exploration") == 0) {
+            options.exploration = atof(value);
+        } else {
+            usage();
+            return 1;
+        }
+        i++;
+    }
+
+    options.actions.push_back(0);
+    for (int k=0; k<16; k++) {
+        bool listed = keys == NULL;
+        for (const char* p = keys; p != NULL && *p; ) {
+            if ((int)strtol(p, NULL, 16) == k) listed = true;
+            p = strchr(p, ',');
+            if (p) p++;
+        }
+        if (listed) {
+            options.actions.push_back(1 << k);
+        }
+    }
+
+    Search* search = new Search();
+    search->options = options;
+    if (!search->root.loadGame(options.game, options.quirks)) {
+        printf("Problem loading the provided game: %s\n", options.game);
+        return 1;
+    }
+    search->iterations_left = options.iterations;
+    search->best_value = -1e300;
+
+    ThreadPool pool(options.threads);
+    auto begin = std::chrono::steady_clock::now();
+    pool.run(searchThread, search, pool.size());
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+
+    printf("%d iterations on %d threads in %.2fs, %d states in the tree\n",
+           options.iterations, pool.size(), elapsed.count(), (int)search->tree.size());
+    printf("Best %s: %g\n", options.score_register >= 0 || options.score_address >= 0 ? "score gain" : "new states", search->best_value.load());
+    printf("Keys held, %d frames each:\n", options.frames_per_action);
+    for (size_t i=0; i<search->best_sequence.size(); i++) {
+        printf("%04X%c", search->best_sequence[i], i % 16 == 15 ? '\n' : ' ');
+    }
+    printf("\n");
+
+    delete search;
+    return 0;
+}
@@ -0,0 +1,193 @@
+// Live counters of running emulators: the GUI, chip8_play and anything built
+// on Chip8Env publish them to shared memory when asked to (--stats, or
+// Chip8Env::stats). Reads every segment it finds, or those of the given
+// pids, and prints each segment's totals and frame times, then the sum. A
+// segment is labelled <pid>-<n>: a process has one for each Chip8Stats it
+// opened.
+//
+//   ./bin/chip8_stats --watch
+//   ./bin/chip8_stats 1234
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <signal.h>
+#include <unistd.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+#include "chip8_stats.h"
+
+
+static void usage() {
+    printf("Usage: ./chip8_stats [pid...] [options]\n"
+           "  --watch      print again every second, with rates since the last time\n"
+           "  --instances  print every instance, not just each process's sum\n");
+}
+
+
+static void add(Chip8StatsCounters& sum, const Chip8StatsCounters& c) {
+    sum.instructions    += c.instructions;
+    sum.frames          += c.frames;
+    sum.draws           += c.draws;
+    sum.idle            += c.idle;
+    sum.audio_underruns += c.audio_underruns;
+    for (int i=0; i<Chip8StatsCounters::FRAME_TIME_BUCKETS; i++) {
+        sum.frame_time[i] += c.frame_time[i];
+    }
+}
+
+
+// The smallest frame time in us that the given share of frames fits under
+static unsigned int percentile(const Chip8StatsCounters& c, double share) {
+    unsigned long long total = 0, count = 0;
+    for (int i=0; i<Chip8StatsCounters::FRAME_TIME_BUCKETS; i++) {
+        total += c.frame_time[i];
+    }
+    for (int i=0; i<Chip8StatsCounters::FRAME_TIME_BUCKETS; i++) {
+        count += c.frame_time[i];
+        if (total && count >= total * share) {
+            return 2u << i;
+        }
+    }
+    return 0;
+}
+
+
+// previous is the same counters a second ago, or NULL for totals only
+static void print(const char* label, const Chip8StatsCounters& c, const Chip8StatsCounters* previous) {
+    printf("%-22s %14llu instr %10llu frames %10llu draws %5.1f%% idle %6llu underruns",
+           label, c.instructions, c.frames, c.draws,
+           c.instructions ? 100.0 * c.idle / c.instructions : 0.0, c.audio_underruns);
+    printf("  frame p50 <%uus p99 <%uus", percentile(c, 0.5), percentile(c, 0.99));
+    if (previous) {
+        printf("  %llu instr/s %llu fps", c.instructions - previous->instructions, c.frames - previous->frames);
+    }
+    putchar('\n');
+}
+
+
+static void printHistogram(const Chip8StatsCounters& c) {
+    printf("frame times:");
+    for (int i=0; i<Chip8StatsCounters::FRAME_TIME_BUCKETS; i++) {
+        if (c.frame_time[i]) {
+            printf(" %s%uus:%llu", i == Chip8StatsCounters::FRAME_TIME_BUCKETS - 1 ? ">=" : "<", 2u << i, c.frame_time[i]);
+        }
+    }
+    putchar('\n');
+}
+
+
+// Segments are files under /dev/shm on Linux, named chip8-stats-<pid>-<n>.
+// Elsewhere, pass the pids: their first few segments are tried by name.
+static std::vector<std::string> findSegments(const char* pid = NULL) {
+    std::string prefix = std::string("chip8-stats-") + (pid ? pid : "");
+    if (pid) {
+        prefix += "-";
+    }
+    std::vector<std::string> names;
+    DIR* dir = opendir("/dev/shm");
+    if (dir) {
+        while (struct dirent* entry = readdir(dir)) {
+            if (strncmp(entry->d_name, prefix.c_str(), prefix.size()) == 0) {
+                names.push_back(std::string("/") + entry->d_name);
+            }
+        }
+        closedir(dir);
+    } else if (pid) {
+        for (int n=0; n<8; n++) {
+            names.push_back("/" + prefix + std::to_string(n));
+        }
+    }
+    return names;
+}
+
+
+int main(int argc, char* argv[]) {
+    bool watch = false;
+    bool instances = false;
+    std::vector<const char*> pids;
+    for (int i=1; i<argc; i++) {
+        if (strcmp(argv[i], "--watch") == 0) {
+            watch = true;
+        } else if (strcmp(argv[i], "--instances") == 0) {
+            instances = true;
+        } else if (argv[i][0] != '-' && atoi(argv[i]) > 0) {
+            pids.push_back(argv[i]);
+        } else {
+            usage();
+            return 1;
+        }
+    }
+
+    std::map<std::string, Chip8StatsCounters> previous;
+    for (;;) {
+        std::vector<std::string> names;
+        if (pids.empty()) {
+            names = findSegments();
+        }
+        for (size_t p=0; p<pids.size(); p++) {
+            std::vector<std::string> found = findSegments(pids[p]);
+            names.insert(names.end(), found.begin(), found.end());
+        }
+        std::sort(names.begin(), names.end());
+
+        std::map<std::string, Chip8StatsCounters> current;
+        Chip8StatsCounters total = {};
+        for (size_t n=0; n<names.size(); n++) {
+            Chip8Stats stats;
+            if (!stats.attach(names[n].c_str())) {
+                continue; // gone since, or never there
+            }
+
+            // a process that was killed leaves its segment behind
+            bool running = kill(stats.header->pid, 0) == 0 || errno == EPERM;
+            Chip8StatsCounters sum = {};
+            for (unsigned int i=0; i<stats.header->instances; i++) {
+                Chip8StatsCounters c;
+                if (!stats.read(i, c)) {
+                    continue;
+                }
+                add(sum, c);
+                if (instances) {
+                    char label[64];
+                    snprintf(label, sizeof(label), "  %s/%u", names[n].c_str() + strlen("/chip8-stats-"), i);
+                    print(label, c, NULL);
+                }
+            }
+
+            // a process can have more than one segment, the name tells them apart
+            char label[64];
+            snprintf(label, sizeof(label), "%s%s", names[n].c_str() + strlen("/chip8-stats-"), running ? "" : " (exited)");
+            auto last = previous.find(names[n]);
+            print(label, sum, watch && last != previous.end() ? &last->second : NULL);
+            current[names[n]] = sum;
+            add(total, sum);
+        }
+        if (current.empty()) {
+            printf("No running emulators publish stats\n");
+        } else if (current.size() > 1) {
+            Chip8StatsCounters before = {};
+            bool rates = watch && !previous.empty();
+            for (auto& c : current) {
+                auto last = previous.find(c.first);
+                add(before, last != previous.end() ? last->second : c.second);
+            }
+            print("total", total, rates ? &before : NULL);
+        }
+        if (!current.empty()) {
+            printHistogram(total);
+        }
+
+        if (!watch) {
+            return 0;
+        }
+        previous = current;
+        putchar('\n');
+        fflush(stdout);
+        sleep(1);
+    }
+}